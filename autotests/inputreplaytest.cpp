@@ -0,0 +1,206 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "inputreplay.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTest>
+#include <QVector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Stands in for the portal's input channel and fake_input: reads the packets the replay sends
+// and applies the events a session with keyboard and pointer permissions may send. Latency is
+// bucketed the way InputLatency does it.
+class MockFakeInput
+{
+public:
+    explicit MockFakeInput(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    void read(const QVector<qint64> &sentAt, const QElapsedTimer &clock)
+    {
+        InputEvent event;
+        while (recv(m_fd, &event, sizeof(event), MSG_DONTWAIT) == ssize_t(sizeof(event))) {
+            const qint64 receivedAt = clock.nsecsElapsed();
+            const int index = m_received++;
+            if (event.type == InputEvent::TouchDown || event.type == InputEvent::TouchMotion || event.type == InputEvent::TouchUp) {
+                continue;
+            }
+
+            const qint64 microseconds = (receivedAt - sentAt.at(index)) / 1000;
+            int bucket = 0;
+            while (bucket < m_dispatched.count() - 1 && (qint64(1) << bucket) <= microseconds) {
+                ++bucket;
+            }
+            ++m_dispatched[bucket];
+        }
+    }
+
+    int received() const { return m_received; }
+    QList<uint> dispatched() const { return m_dispatched; }
+
+private:
+    const int m_fd;
+    int m_received = 0;
+    QList<uint> m_dispatched = QVector<uint>(24, 0).toList();
+};
+
+class InputReplayTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testRecordingRoundTrip();
+    void testForeignFile();
+    void testPercentile();
+    void testReplayAgainstMockFakeInput();
+    void testClosedChannelDrops();
+
+private:
+    static QVector<InputRecording::Record> recording();
+};
+
+QVector<InputRecording::Record> InputReplayTest::recording()
+{
+    QVector<InputRecording::Record> records;
+    qint64 timestamp = 0;
+    const auto add = [&] (quint32 type, quint32 arg, quint32 arg2, double x, double y) {
+        timestamp += 1000000;
+        records.append(InputRecording::Record{timestamp, InputEvent{type, arg, arg2, 0, x, y}});
+    };
+
+    for (int i = 0; i < 20; ++i) {
+        add(InputEvent::PointerMotion, 0, 0, 1, -1);
+    }
+    add(InputEvent::PointerButton, 272, 1, 0, 0);
+    add(InputEvent::PointerButton, 272, 0, 0, 0);
+    add(InputEvent::KeyboardKeycode, 30, 1, 0, 0);
+    add(InputEvent::KeyboardKeycode, 30, 0, 0, 0);
+    // Not permitted, these count as dropped by the portal
+    add(InputEvent::TouchDown, 42, 0, 10, 10);
+    add(InputEvent::TouchMotion, 42, 0, 20, 20);
+    add(InputEvent::TouchUp, 0, 0, 0, 0);
+    return records;
+}
+
+void InputReplayTest::testRecordingRoundTrip()
+{
+    const QVector<InputRecording::Record> records = recording();
+
+    QByteArray data(InputRecording::magic, sizeof(InputRecording::magic));
+    data.append(reinterpret_cast<const char *>(records.constData()), records.size() * sizeof(InputRecording::Record));
+    QBuffer buffer(&data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    QString errorString;
+    const QVector<InputRecording::Record> read = InputReplay::readRecording(&buffer, &errorString);
+    QCOMPARE(read.count(), records.count());
+    QVERIFY(errorString.isEmpty());
+    for (int i = 0; i < records.count(); ++i) {
+        QCOMPARE(read.at(i).timestamp, records.at(i).timestamp);
+        QCOMPARE(read.at(i).event.type, records.at(i).event.type);
+        QCOMPARE(read.at(i).event.arg, records.at(i).event.arg);
+        QCOMPARE(read.at(i).event.x, records.at(i).event.x);
+    }
+}
+
+void InputReplayTest::testForeignFile()
+{
+    QByteArray data("#!/bin/sh\necho hello\n");
+    QBuffer buffer(&data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    QString errorString;
+    QVERIFY(InputReplay::readRecording(&buffer, &errorString).isEmpty());
+    QVERIFY(!errorString.isEmpty());
+}
+
+void InputReplayTest::testPercentile()
+{
+    const QList<uint> buckets = {0, 5, 3, 2};
+    QCOMPARE(InputReplay::count(buckets), quint64(10));
+    QCOMPARE(InputReplay::percentile(buckets, 0.5), 2u);
+    QCOMPARE(InputReplay::percentile(buckets, 0.9), 8u);
+    QCOMPARE(InputReplay::percentile(buckets, 0.99), 8u);
+    QCOMPARE(InputReplay::percentile(QList<uint>(), 0.5), 0u);
+}
+
+void InputReplayTest::testReplayAgainstMockFakeInput()
+{
+    // Same kind of socket the portal hands out for the input channel
+    int fds[2];
+    QCOMPARE(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds), 0);
+    MockFakeInput fakeInput(fds[0]);
+
+    const QVector<InputRecording::Record> records = recording();
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> sentAt;
+
+    InputReplay::Report report;
+    report.recorded = records.count();
+    for (const InputRecording::Record &record : records) {
+        sentAt.append(clock.nsecsElapsed());
+        if (InputReplay::sendToChannel(fds[1], record.event)) {
+            ++report.sent;
+        }
+    }
+    fakeInput.read(sentAt, clock);
+    report.handled = InputReplay::count(fakeInput.dispatched());
+
+    QCOMPARE(fakeInput.received(), records.count());
+    QCOMPARE(report.droppedWhileSending(), 0);
+    QCOMPARE(report.droppedByPortal(), quint64(3));
+    QCOMPARE(report.handled, quint64(records.count() - 3));
+
+    const uint p50 = InputReplay::percentile(fakeInput.dispatched(), 0.5);
+    const uint p99 = InputReplay::percentile(fakeInput.dispatched(), 0.99);
+    QVERIFY(p50 > 0);
+    QVERIFY(p99 >= p50);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void InputReplayTest::testClosedChannelDrops()
+{
+    int fds[2];
+    QCOMPARE(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds), 0);
+    // The portal closes its end e.g. after an oversized packet
+    close(fds[0]);
+
+    const QVector<InputRecording::Record> records = recording();
+    InputReplay::Report report;
+    report.recorded = records.count();
+    for (const InputRecording::Record &record : records) {
+        if (InputReplay::sendToChannel(fds[1], record.event)) {
+            ++report.sent;
+        }
+    }
+
+    QCOMPARE(report.sent, 0);
+    QCOMPARE(report.droppedWhileSending(), records.count());
+    QCOMPARE(report.droppedByPortal(), quint64(0));
+
+    close(fds[1]);
+}
+
+QTEST_GUILESS_MAIN(InputReplayTest)
+
+#include "inputreplaytest.moc"
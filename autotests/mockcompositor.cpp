@@ -0,0 +1,324 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mockcompositor.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include <wayland-server.h>
+#include "wayland-fake-input-server-protocol.h"
+#include "wayland-zkde-screencast-unstable-v1-server-protocol.h"
+
+class MockCompositorPrivate
+{
+public:
+    struct OutputGlobal {
+        MockCompositorPrivate *d;
+        MockCompositor::Output output;
+        wl_global *global;
+    };
+
+    OutputGlobal *createOutput(const MockCompositor::Output &output);
+    void destroyOutput(OutputGlobal *output);
+    wl_resource *createStream(wl_client *client, uint32_t id, MockCompositor::StreamRequest request);
+    void record(const QString &request);
+
+    // Only touched by the server thread while it runs
+    wl_display *display = nullptr;
+    std::thread thread;
+    std::atomic<bool> quit{false};
+    QVector<MockCompositor::Output> outputs;
+    // Kept until the display goes away, clients may still hold resources of removed outputs
+    QList<OutputGlobal *> outputGlobals;
+    QHash<wl_resource *, OutputGlobal *> virtualOutputs;
+    uint nextNode = 100;
+
+    mutable QMutex mutex;
+    QVector<MockCompositor::StreamRequest> streamRequests;
+    int closedStreams = 0;
+    QStringList fakeInputRequests;
+};
+
+static MockCompositorPrivate *compositorFor(wl_resource *resource)
+{
+    return static_cast<MockCompositorPrivate *>(wl_resource_get_user_data(resource));
+}
+
+static void bindOutput(wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    const auto global = static_cast<MockCompositorPrivate::OutputGlobal *>(data);
+    const MockCompositor::Output &output = global->output;
+
+    // Up to version 2 wl_output has no requests
+    wl_resource *resource = wl_resource_create(client, &wl_output_interface, version, id);
+    wl_resource_set_implementation(resource, nullptr, global, nullptr);
+
+    wl_output_send_geometry(resource, output.position.x(), output.position.y(), 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN,
+                            "Mock", output.model.toUtf8().constData(), WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED, output.size.width(), output.size.height(), 60000);
+    wl_output_send_scale(resource, output.scale);
+    wl_output_send_done(resource);
+}
+
+static struct zkde_screencast_stream_unstable_v1_interface streamImplementation()
+{
+    struct zkde_screencast_stream_unstable_v1_interface implementation = {};
+    implementation.close = [] (wl_client *, wl_resource *resource) {
+        MockCompositorPrivate *d = compositorFor(resource);
+        {
+            QMutexLocker locker(&d->mutex);
+            ++d->closedStreams;
+        }
+        wl_resource_destroy(resource);
+    };
+    return implementation;
+}
+
+static const struct zkde_screencast_stream_unstable_v1_interface s_streamImplementation = streamImplementation();
+
+static void destroyStream(wl_resource *resource)
+{
+    // Like KWin, the virtual output goes away with its stream
+    MockCompositorPrivate *d = compositorFor(resource);
+    if (MockCompositorPrivate::OutputGlobal *output = d->virtualOutputs.take(resource)) {
+        d->destroyOutput(output);
+    }
+}
+
+static struct zkde_screencast_unstable_v1_interface screencastImplementation()
+{
+    struct zkde_screencast_unstable_v1_interface implementation = {};
+    implementation.stream_output = [] (wl_client *client, wl_resource *resource, uint32_t stream, wl_resource *output, uint32_t pointer) {
+        const auto global = static_cast<MockCompositorPrivate::OutputGlobal *>(wl_resource_get_user_data(output));
+        MockCompositor::StreamRequest request;
+        request.type = QStringLiteral("output");
+        request.target = global->output.model;
+        request.size = global->output.size;
+        request.pointer = pointer;
+        compositorFor(resource)->createStream(client, stream, request);
+    };
+    implementation.stream_window = [] (wl_client *client, wl_resource *resource, uint32_t stream, const char *uuid, uint32_t pointer) {
+        MockCompositor::StreamRequest request;
+        request.type = QStringLiteral("window");
+        request.target = QString::fromUtf8(uuid);
+        request.pointer = pointer;
+        compositorFor(resource)->createStream(client, stream, request);
+    };
+    implementation.destroy = [] (wl_client *, wl_resource *resource) {
+        wl_resource_destroy(resource);
+    };
+    implementation.stream_virtual_output = [] (wl_client *client, wl_resource *resource, uint32_t stream, const char *name,
+                                               int32_t width, int32_t height, wl_fixed_t scale, uint32_t pointer) {
+        MockCompositorPrivate *d = compositorFor(resource);
+
+        MockCompositor::StreamRequest request;
+        request.type = QStringLiteral("virtual");
+        request.target = QString::fromUtf8(name);
+        request.size = QSize(width, height);
+        request.scale = wl_fixed_to_double(scale);
+        request.pointer = pointer;
+
+        // wl_output only knows integer scales, they are rounded up
+        MockCompositor::Output output;
+        output.model = request.target;
+        output.position = MockCompositor::virtualOutputPosition();
+        output.size = request.size;
+        output.scale = int(std::ceil(request.scale));
+        MockCompositorPrivate::OutputGlobal *global = d->createOutput(output);
+        d->virtualOutputs.insert(d->createStream(client, stream, request), global);
+    };
+    return implementation;
+}
+
+static const struct zkde_screencast_unstable_v1_interface s_screencastImplementation = screencastImplementation();
+
+static void bindScreencast(wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    wl_resource *resource = wl_resource_create(client, &zkde_screencast_unstable_v1_interface, version, id);
+    wl_resource_set_implementation(resource, &s_screencastImplementation, data, nullptr);
+}
+
+static struct org_kde_kwin_fake_input_interface fakeInputImplementation()
+{
+    struct org_kde_kwin_fake_input_interface implementation = {};
+    implementation.authenticate = [] (wl_client *, wl_resource *resource, const char *, const char *) {
+        compositorFor(resource)->record(QStringLiteral("authenticate"));
+    };
+    implementation.pointer_motion = [] (wl_client *, wl_resource *resource, wl_fixed_t dx, wl_fixed_t dy) {
+        compositorFor(resource)->record(QStringLiteral("pointer_motion %1 %2").arg(wl_fixed_to_double(dx)).arg(wl_fixed_to_double(dy)));
+    };
+    implementation.button = [] (wl_client *, wl_resource *resource, uint32_t button, uint32_t state) {
+        compositorFor(resource)->record(QStringLiteral("button %1 %2").arg(button).arg(state));
+    };
+    implementation.axis = [] (wl_client *, wl_resource *resource, uint32_t axis, wl_fixed_t value) {
+        compositorFor(resource)->record(QStringLiteral("axis %1 %2").arg(axis).arg(wl_fixed_to_double(value)));
+    };
+    implementation.touch_down = [] (wl_client *, wl_resource *resource, uint32_t id, wl_fixed_t x, wl_fixed_t y) {
+        compositorFor(resource)->record(QStringLiteral("touch_down %1 %2 %3").arg(id).arg(wl_fixed_to_double(x)).arg(wl_fixed_to_double(y)));
+    };
+    implementation.touch_motion = [] (wl_client *, wl_resource *resource, uint32_t id, wl_fixed_t x, wl_fixed_t y) {
+        compositorFor(resource)->record(QStringLiteral("touch_motion %1 %2 %3").arg(id).arg(wl_fixed_to_double(x)).arg(wl_fixed_to_double(y)));
+    };
+    implementation.touch_up = [] (wl_client *, wl_resource *resource, uint32_t id) {
+        compositorFor(resource)->record(QStringLiteral("touch_up %1").arg(id));
+    };
+    implementation.touch_cancel = [] (wl_client *, wl_resource *resource) {
+        compositorFor(resource)->record(QStringLiteral("touch_cancel"));
+    };
+    implementation.touch_frame = [] (wl_client *, wl_resource *resource) {
+        compositorFor(resource)->record(QStringLiteral("touch_frame"));
+    };
+    implementation.pointer_motion_absolute = [] (wl_client *, wl_resource *resource, wl_fixed_t x, wl_fixed_t y) {
+        compositorFor(resource)->record(QStringLiteral("pointer_motion_absolute %1 %2").arg(wl_fixed_to_double(x)).arg(wl_fixed_to_double(y)));
+    };
+    implementation.keyboard_key = [] (wl_client *, wl_resource *resource, uint32_t key, uint32_t state) {
+        compositorFor(resource)->record(QStringLiteral("keyboard_key %1 %2").arg(key).arg(state));
+    };
+    return implementation;
+}
+
+static const struct org_kde_kwin_fake_input_interface s_fakeInputImplementation = fakeInputImplementation();
+
+static void bindFakeInput(wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    wl_resource *resource = wl_resource_create(client, &org_kde_kwin_fake_input_interface, version, id);
+    wl_resource_set_implementation(resource, &s_fakeInputImplementation, data, nullptr);
+}
+
+MockCompositorPrivate::OutputGlobal *MockCompositorPrivate::createOutput(const MockCompositor::Output &output)
+{
+    auto global = new OutputGlobal{this, output, nullptr};
+    global->global = wl_global_create(display, &wl_output_interface, 2, global, bindOutput);
+    outputGlobals.append(global);
+    return global;
+}
+
+void MockCompositorPrivate::destroyOutput(OutputGlobal *output)
+{
+    if (output->global) {
+        wl_global_destroy(output->global);
+        output->global = nullptr;
+    }
+}
+
+wl_resource *MockCompositorPrivate::createStream(wl_client *client, uint32_t id, MockCompositor::StreamRequest request)
+{
+    wl_resource *stream = wl_resource_create(client, &zkde_screencast_stream_unstable_v1_interface, 1, id);
+    wl_resource_set_implementation(stream, &s_streamImplementation, this, destroyStream);
+
+    request.node = nextNode++;
+    {
+        QMutexLocker locker(&mutex);
+        streamRequests.append(request);
+    }
+    zkde_screencast_stream_unstable_v1_send_created(stream, request.node);
+    return stream;
+}
+
+void MockCompositorPrivate::record(const QString &request)
+{
+    QMutexLocker locker(&mutex);
+    fakeInputRequests.append(request);
+}
+
+MockCompositor::MockCompositor()
+    : d(new MockCompositorPrivate)
+{
+}
+
+MockCompositor::~MockCompositor()
+{
+    stop();
+}
+
+void MockCompositor::addOutput(const Output &output)
+{
+    d->outputs.append(output);
+}
+
+bool MockCompositor::start(const QString &socketName)
+{
+    d->display = wl_display_create();
+    if (wl_display_add_socket(d->display, socketName.toUtf8().constData()) != 0) {
+        wl_display_destroy(d->display);
+        d->display = nullptr;
+        return false;
+    }
+
+    wl_global_create(d->display, &zkde_screencast_unstable_v1_interface, zkde_screencast_unstable_v1_interface.version, d.get(), bindScreencast);
+    // Version 4 has everything the portal sends
+    wl_global_create(d->display, &org_kde_kwin_fake_input_interface, qMin(org_kde_kwin_fake_input_interface.version, 4), d.get(), bindFakeInput);
+    for (const Output &output : qAsConst(d->outputs)) {
+        d->createOutput(output);
+    }
+
+    d->quit = false;
+    d->thread = std::thread([this] {
+        wl_event_loop *loop = wl_display_get_event_loop(d->display);
+        while (!d->quit) {
+            wl_display_flush_clients(d->display);
+            wl_event_loop_dispatch(loop, 10);
+        }
+    });
+    return true;
+}
+
+void MockCompositor::stop()
+{
+    if (!d->display) {
+        return;
+    }
+
+    d->quit = true;
+    d->thread.join();
+
+    wl_display_destroy_clients(d->display);
+    wl_display_destroy(d->display);
+    d->display = nullptr;
+
+    d->virtualOutputs.clear();
+    qDeleteAll(d->outputGlobals);
+    d->outputGlobals.clear();
+}
+
+QVector<MockCompositor::StreamRequest> MockCompositor::streamRequests() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->streamRequests;
+}
+
+int MockCompositor::closedStreams() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->closedStreams;
+}
+
+QStringList MockCompositor::fakeInputRequests() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->fakeInputRequests;
+}
+
+void MockCompositor::clearFakeInputRequests()
+{
+    QMutexLocker locker(&d->mutex);
+    d->fakeInputRequests.clear();
+}
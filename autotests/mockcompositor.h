@@ -0,0 +1,74 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_MOCK_COMPOSITOR_H
+#define XDG_DESKTOP_PORTAL_KDE_MOCK_COMPOSITOR_H
+
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+class MockCompositorPrivate;
+
+// A Wayland server with just what WaylandIntegration binds: wl_output, zkde_screencast_unstable_v1
+// and org_kde_kwin_fake_input. It runs in a thread of its own and records what clients request.
+class MockCompositor
+{
+public:
+    struct Output {
+        QString model;
+        QPoint position;
+        QSize size;
+        int scale = 1;
+    };
+
+    struct StreamRequest {
+        // "output", "window" or "virtual"
+        QString type;
+        // Output model, window uuid or virtual output name
+        QString target;
+        QSize size;
+        double scale = 1;
+        uint pointer = 0;
+        uint node = 0;
+    };
+
+    MockCompositor();
+    ~MockCompositor();
+
+    // Outputs which are there from the start, also after a restart
+    void addOutput(const Output &output);
+    // Where virtual outputs end up, with the name they were requested with as model
+    static QPoint virtualOutputPosition() { return QPoint(3000, 0); }
+
+    bool start(const QString &socketName);
+    // Drops every client, like a crashing compositor does
+    void stop();
+
+    QVector<StreamRequest> streamRequests() const;
+    int closedStreams() const;
+    // Requests on fake_input as text, e.g. "touch_down 0 110 220"
+    QStringList fakeInputRequests() const;
+    void clearFakeInputRequests();
+
+private:
+    std::unique_ptr<MockCompositorPrivate> d;
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_MOCK_COMPOSITOR_H
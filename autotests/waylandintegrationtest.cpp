@@ -0,0 +1,251 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mockcompositor.h"
+#include "screencast.h"
+#include "waylandintegration.h"
+
+#include <QFile>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+class WaylandIntegrationTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void testCursorModeValidation_data();
+    void testCursorModeValidation();
+    void testCursorModeReachesCompositor_data();
+    void testCursorModeReachesCompositor();
+    void testVirtualOutputBinding();
+    void testTouchIdsPerSession();
+    // Last, it takes the compositor away
+    void testReconnect();
+
+private:
+    static quint32 outputNamed(const QString &model);
+
+    QTemporaryDir m_runtimeDir;
+    QString m_socketName;
+    MockCompositor m_compositor;
+};
+
+quint32 WaylandIntegrationTest::outputNamed(const QString &model)
+{
+    const WaylandIntegration::WaylandOutputs outputs = WaylandIntegration::screens();
+    for (const WaylandIntegration::WaylandOutput &output : *outputs) {
+        if (output.model() == model) {
+            return output.waylandOutputName();
+        }
+    }
+    return 0;
+}
+
+void WaylandIntegrationTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    if (qEnvironmentVariableIsEmpty("XDG_RUNTIME_DIR")) {
+        QVERIFY(m_runtimeDir.isValid());
+        qputenv("XDG_RUNTIME_DIR", QFile::encodeName(m_runtimeDir.path()));
+    }
+
+    m_compositor.addOutput({QStringLiteral("Physical"), QPoint(100, 200), QSize(1920, 1080), 1});
+    m_socketName = QStringLiteral("xdp-kde-test-%1").arg(QCoreApplication::applicationPid());
+    QVERIFY(m_compositor.start(m_socketName));
+    qputenv("WAYLAND_DISPLAY", m_socketName.toUtf8());
+
+    WaylandIntegration::init();
+    WaylandIntegration::authenticate();
+    QTRY_VERIFY(WaylandIntegration::isStreamingAvailable());
+    QTRY_VERIFY(outputNamed(QStringLiteral("Physical")));
+    QTRY_VERIFY(m_compositor.fakeInputRequests().contains(QStringLiteral("authenticate")));
+}
+
+void WaylandIntegrationTest::cleanupTestCase()
+{
+    m_compositor.stop();
+}
+
+void WaylandIntegrationTest::init()
+{
+    m_compositor.clearFakeInputRequests();
+}
+
+void WaylandIntegrationTest::testCursorModeValidation_data()
+{
+    QTest::addColumn<uint>("mode");
+    QTest::addColumn<bool>("supported");
+
+    QTest::newRow("hidden") << uint(ScreenCastPortal::Hidden) << true;
+    QTest::newRow("embedded") << uint(ScreenCastPortal::Embedded) << true;
+    QTest::newRow("metadata") << uint(ScreenCastPortal::Metadata) << true;
+    QTest::newRow("none") << 0u << false;
+    QTest::newRow("several") << uint(ScreenCastPortal::Hidden | ScreenCastPortal::Metadata) << false;
+    QTest::newRow("unknown") << 8u << false;
+}
+
+void WaylandIntegrationTest::testCursorModeValidation()
+{
+    QFETCH(uint, mode);
+    QFETCH(bool, supported);
+
+    QCOMPARE(ScreenCastPortal::isCursorModeSupported(mode), supported);
+}
+
+void WaylandIntegrationTest::testCursorModeReachesCompositor_data()
+{
+    QTest::addColumn<Screencasting::CursorMode>("mode");
+
+    QTest::newRow("hidden") << Screencasting::Hidden;
+    QTest::newRow("embedded") << Screencasting::Embedded;
+    QTest::newRow("metadata") << Screencasting::Metadata;
+}
+
+void WaylandIntegrationTest::testCursorModeReachesCompositor()
+{
+    QFETCH(Screencasting::CursorMode, mode);
+
+    const int closedStreams = m_compositor.closedStreams();
+    const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming({outputNamed(QStringLiteral("Physical"))}, {}, mode);
+    QCOMPARE(streams.count(), 1);
+    QCOMPARE(streams.first().map.value(QStringLiteral("source_type")).toUInt(), uint(ScreenCastPortal::Monitor));
+    QCOMPARE(streams.first().map.value(QStringLiteral("position")).toPoint(), QPoint(100, 200));
+
+    const MockCompositor::StreamRequest request = m_compositor.streamRequests().constLast();
+    QCOMPARE(request.type, QStringLiteral("output"));
+    QCOMPARE(request.target, QStringLiteral("Physical"));
+    QCOMPARE(request.pointer, uint(mode));
+    QCOMPARE(request.node, streams.first().nodeId);
+
+    streams.first().close();
+    QTRY_COMPARE(m_compositor.closedStreams(), closedStreams + 1);
+}
+
+void WaylandIntegrationTest::testVirtualOutputBinding()
+{
+    const QString name = QStringLiteral("xdp-kde-session-1");
+
+    // Queued behind WaylandIntegration's own handling of the new output
+    QObject context;
+    bool outputAdded = false;
+    connect(WaylandIntegration::waylandIntegration(), &WaylandIntegration::WaylandIntegration::outputAdded, &context, [&outputAdded] {
+        outputAdded = true;
+    }, Qt::QueuedConnection);
+
+    const WaylandIntegration::Streams streams = WaylandIntegration::startStreamingVirtualOutput(name, QSize(1280, 720), 2, Screencasting::Metadata);
+    QCOMPARE(streams.count(), 1);
+    QCOMPARE(streams.first().map.value(QStringLiteral("source_type")).toUInt(), uint(ScreenCastPortal::Virtual));
+    QCOMPARE(streams.first().map.value(QStringLiteral("size")).toSize(), QSize(1280, 720));
+
+    const MockCompositor::StreamRequest request = m_compositor.streamRequests().constLast();
+    QCOMPARE(request.type, QStringLiteral("virtual"));
+    QCOMPARE(request.target, name);
+    QCOMPARE(request.size, QSize(1280, 720));
+    QCOMPARE(request.scale, 2.0);
+    QCOMPARE(request.pointer, uint(Screencasting::Metadata));
+
+    QTRY_VERIFY(outputAdded);
+    QVERIFY(outputNamed(name));
+
+    // Stream coordinates are device pixels, mapped onto the output the compositor made for it
+    WaylandIntegration::requestPointerMotionAbsolute(QStringLiteral("/session/a"), streams.first().nodeId, QPointF(200, 100));
+    const QPoint expected = MockCompositor::virtualOutputPosition() + QPoint(100, 50);
+    QTRY_COMPARE(m_compositor.fakeInputRequests(),
+                 QStringList{QStringLiteral("pointer_motion_absolute %1 %2").arg(expected.x()).arg(expected.y())});
+
+    // The output goes away with the stream
+    streams.first().close();
+    QTRY_VERIFY(!outputNamed(name));
+    WaylandIntegration::releaseInput(QStringLiteral("/session/a"));
+}
+
+void WaylandIntegrationTest::testTouchIdsPerSession()
+{
+    const QString sessionA = QStringLiteral("/session/a");
+    const QString sessionB = QStringLiteral("/session/b");
+
+    const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming({outputNamed(QStringLiteral("Physical"))}, {}, Screencasting::Hidden);
+    QCOMPARE(streams.count(), 1);
+    const uint nodeId = streams.first().nodeId;
+
+    // Both sessions use slot 5, they must not end up on the same touch point
+    WaylandIntegration::requestTouchDown(sessionA, nodeId, 5, QPointF(10, 20));
+    WaylandIntegration::requestTouchDown(sessionB, nodeId, 5, QPointF(30, 40));
+    // Merged into a single motion, which goes out before the touch point is lifted
+    WaylandIntegration::requestTouchMotion(sessionA, nodeId, 5, QPointF(11, 21));
+    WaylandIntegration::requestTouchMotion(sessionA, nodeId, 5, QPointF(12, 22));
+    WaylandIntegration::requestTouchUp(sessionA, 5);
+    // A closed session doesn't leave its fingers on the screen
+    WaylandIntegration::releaseInput(sessionB);
+
+    const QStringList expected = {
+        QStringLiteral("touch_down 0 110 220"),
+        QStringLiteral("touch_frame"),
+        QStringLiteral("touch_down 1 130 240"),
+        QStringLiteral("touch_frame"),
+        QStringLiteral("touch_motion 0 112 222"),
+        QStringLiteral("touch_frame"),
+        QStringLiteral("touch_up 0"),
+        QStringLiteral("touch_frame"),
+        QStringLiteral("touch_up 1"),
+        QStringLiteral("touch_frame"),
+    };
+    QTRY_COMPARE(m_compositor.fakeInputRequests(), expected);
+
+    // Ids are free again
+    m_compositor.clearFakeInputRequests();
+    WaylandIntegration::requestTouchDown(sessionB, nodeId, 0, QPointF(0, 0));
+    WaylandIntegration::releaseInput(sessionB);
+    QTRY_COMPARE(m_compositor.fakeInputRequests(), QStringList({QStringLiteral("touch_down 0 100 200"), QStringLiteral("touch_frame"),
+                                                                 QStringLiteral("touch_up 0"), QStringLiteral("touch_frame")}));
+
+    streams.first().close();
+}
+
+void WaylandIntegrationTest::testReconnect()
+{
+    const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming({outputNamed(QStringLiteral("Physical"))}, {}, Screencasting::Hidden);
+    QCOMPARE(streams.count(), 1);
+    QSignalSpy closedSpy(streams.first().stream.data(), &ScreencastingStream::closed);
+
+    // Sessions learn that their streams are gone
+    m_compositor.stop();
+    QTRY_COMPARE(closedSpy.count(), 1);
+    QVERIFY(!WaylandIntegration::isStreamingAvailable());
+    QVERIFY(!outputNamed(QStringLiteral("Physical")));
+
+    QVERIFY(m_compositor.start(m_socketName));
+    QTRY_VERIFY_WITH_TIMEOUT(WaylandIntegration::isStreamingAvailable(), 10000);
+    QTRY_VERIFY(outputNamed(QStringLiteral("Physical")));
+
+    // fake_input is bound and authenticated again
+    QTRY_VERIFY(m_compositor.fakeInputRequests().contains(QStringLiteral("authenticate")));
+    WaylandIntegration::requestPointerButtonPress(272);
+    QTRY_VERIFY(m_compositor.fakeInputRequests().contains(QStringLiteral("button 272 1")));
+
+    const WaylandIntegration::Streams restarted = WaylandIntegration::startStreaming({outputNamed(QStringLiteral("Physical"))}, {}, Screencasting::Hidden);
+    QCOMPARE(restarted.count(), 1);
+    restarted.first().close();
+}
+
+QTEST_GUILESS_MAIN(WaylandIntegrationTest)
+
+#include "waylandintegrationtest.moc"
@@ -18,6 +18,7 @@
  */
 
 #include "access.h"
+#include "request.h"
 #include "accessdialog.h"
 #include "utils.h"
 
@@ -55,6 +56,7 @@ uint AccessPortal::AccessDialog(const QDBusObjectPath &handle,
 
     auto accessDialog = new ::AccessDialog();
     Utils::setParentWindow(accessDialog, parent_window);
+    Request::makeClosableDialogRequest(handle, accessDialog);
     accessDialog->setBody(body);
     accessDialog->setTitle(title);
     accessDialog->setSubtitle(subtitle);
@@ -18,6 +18,7 @@
  */
 
 #include "account.h"
+#include "request.h"
 #include "userinfodialog.h"
 #include "utils.h"
 
@@ -54,6 +55,7 @@ uint AccountPortal::GetUserInformation(const QDBusObjectPath &handle,
 
     UserInfoDialog *userInfoDialog = new UserInfoDialog(reason);
     Utils::setParentWindow(userInfoDialog, parent_window);
+    Request::makeClosableDialogRequest(handle, userInfoDialog);
 
     int result = userInfoDialog->exec();
 
@@ -18,6 +18,7 @@
  */
 
 #include "appchooser.h"
+#include "request.h"
 #include "appchooserdialog.h"
 #include "utils.h"
 
@@ -62,6 +63,7 @@ uint AppChooserPortal::ChooseApplication(const QDBusObjectPath &handle,
     AppChooserDialog *appDialog = new AppChooserDialog(choices, latestChoice, itemName.toString(), options.value(QStringLiteral("content_type")).toString());
     m_appChooserDialogs.insert(handle.path(), appDialog);
     Utils::setParentWindow(appDialog, parent_window);
+    Request::makeClosableDialogRequest(handle, appDialog);
 
     int result = appDialog->exec();
 
@@ -42,6 +42,8 @@
 
 #include <KWayland/Client/plasmawindowmanagement.h>
 
+#include <algorithm>
+
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeBackground, "xdp-kde-background")
 
 BackgroundPortal::BackgroundPortal(QObject *parent)
@@ -52,10 +54,20 @@ BackgroundPortal::BackgroundPortal(QObject *parent)
             addWindow(window);
         });
 
-        m_windows = WaylandIntegration::plasmaWindowManagement()->windows();
-        for (KWayland::Client::PlasmaWindow *window : qAsConst(m_windows)) {
+        // We might be here again after reconnecting to the compositor, start from scratch
+        for (auto it = m_appIdOfWindow.cbegin(), itEnd = m_appIdOfWindow.cend(); it != itEnd; ++it) {
+            disconnect(it.key(), nullptr, this, nullptr);
+        }
+        m_appIdOfWindow.clear();
+        m_windowsByAppId.clear();
+        m_appStates.clear();
+
+        const auto windows = WaylandIntegration::plasmaWindowManagement()->windows();
+        for (KWayland::Client::PlasmaWindow *window : windows) {
             addWindow(window);
         }
+
+        Q_EMIT RunningApplicationsChanged();
     });
 }
 
@@ -204,35 +216,80 @@ bool BackgroundPortal::EnableAutostart(const QString &app_id,
 
 void BackgroundPortal::addWindow(KWayland::Client::PlasmaWindow *window)
 {
+    if (m_appIdOfWindow.contains(window)) {
+        return;
+    }
+
     const QString appId = window->appId();
-    const bool isActive = window->isActive();
-    m_appStates[appId] = QVariant::fromValue<uint>(isActive ? Active : Running);
+    m_appIdOfWindow.insert(window, appId);
+    m_windowsByAppId[appId].insert(window);
 
     connect(window, &KWayland::Client::PlasmaWindow::activeChanged, this, [this, window] () {
-        setActiveWindow(window->appId(), window->isActive());
+        updateAppState(m_appIdOfWindow.value(window));
+    });
+    connect(window, &KWayland::Client::PlasmaWindow::appIdChanged, this, [this, window] () {
+        updateAppId(window);
     });
     connect(window, &KWayland::Client::PlasmaWindow::unmapped, this, [this, window] () {
-        uint windows = 0;
-        const QString appId = window->appId();
-        const auto plasmaWindows = WaylandIntegration::plasmaWindowManagement()->windows();
-        for (KWayland::Client::PlasmaWindow *otherWindow : plasmaWindows) {
-            if (otherWindow->appId() == appId && otherWindow->uuid() != window->uuid()) {
-                windows++;
-            }
-        }
-
-        if (!windows) {
-            m_appStates.remove(appId);
-            Q_EMIT RunningApplicationsChanged();
-        }
+        removeWindow(window);
+    });
+    // Should be unmapped before, but don't keep a dangling pointer around if it isn't
+    connect(window, &QObject::destroyed, this, [this, window] () {
+        removeWindow(window);
     });
 
-    Q_EMIT RunningApplicationsChanged();
+    updateAppState(appId);
 }
 
-void BackgroundPortal::setActiveWindow(const QString &appId, bool active)
+void BackgroundPortal::removeWindow(KWayland::Client::PlasmaWindow *window)
 {
-    m_appStates[appId] = QVariant::fromValue<uint>(active ? Active : Running);
+    const auto it = m_appIdOfWindow.constFind(window);
+    if (it == m_appIdOfWindow.cend()) {
+        return;
+    }
+
+    const QString appId = it.value();
+    m_appIdOfWindow.erase(it);
+    m_windowsByAppId[appId].remove(window);
+    disconnect(window, nullptr, this, nullptr);
+
+    updateAppState(appId);
+}
 
-    Q_EMIT RunningApplicationsChanged();
+void BackgroundPortal::updateAppId(KWayland::Client::PlasmaWindow *window)
+{
+    const QString oldAppId = m_appIdOfWindow.value(window);
+    const QString appId = window->appId();
+    if (oldAppId == appId) {
+        return;
+    }
+
+    m_windowsByAppId[oldAppId].remove(window);
+    m_windowsByAppId[appId].insert(window);
+    m_appIdOfWindow.insert(window, appId);
+
+    updateAppState(oldAppId);
+    updateAppState(appId);
+}
+
+void BackgroundPortal::updateAppState(const QString &appId)
+{
+    const auto it = m_windowsByAppId.constFind(appId);
+    if (it == m_windowsByAppId.cend() || it->isEmpty()) {
+        m_windowsByAppId.remove(appId);
+        if (m_appStates.remove(appId)) {
+            Q_EMIT RunningApplicationsChanged();
+        }
+        return;
+    }
+
+    const bool isActive = std::any_of(it->cbegin(), it->cend(), [] (KWayland::Client::PlasmaWindow *window) {
+        return window->isActive();
+    });
+    const QVariant state = QVariant::fromValue<uint>(isActive ? Active : Running);
+
+    if (m_appStates.value(appId) != state) {
+        m_appStates.insert(appId, state);
+        Q_EMIT RunningApplicationsChanged();
+    }
 }
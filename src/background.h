@@ -23,6 +23,8 @@
 
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
+#include <QHash>
+#include <QSet>
 
 namespace KWayland {
     namespace Client {
@@ -73,10 +75,15 @@ Q_SIGNALS:
 
 private:
     void addWindow(KWayland::Client::PlasmaWindow *window);
-    void setActiveWindow(const QString &appId, bool active);
+    void removeWindow(KWayland::Client::PlasmaWindow *window);
+    void updateAppId(KWayland::Client::PlasmaWindow *window);
+    void updateAppState(const QString &appId);
 
     uint m_notificationCounter = 0;
-    QList<KWayland::Client::PlasmaWindow*> m_windows;
+    // Live windows of every application, so updating an application's state doesn't need to
+    // look at the windows of all other applications
+    QHash<QString, QSet<KWayland::Client::PlasmaWindow*>> m_windowsByAppId;
+    QHash<KWayland::Client::PlasmaWindow*, QString> m_appIdOfWindow;
     QVariantMap m_appStates;
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(BackgroundPortal::AutostartFlags)
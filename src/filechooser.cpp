@@ -19,6 +19,7 @@
  */
 
 #include "filechooser.h"
+#include "request.h"
 #include "utils.h"
 
 #include <QDialogButtonBox>
@@ -268,6 +269,7 @@ uint FileChooserPortal::OpenFile(const QDBusObjectPath &handle,
 
     QScopedPointer<FileDialog, QScopedPointerDeleteLater> fileDialog(new FileDialog());
     Utils::setParentWindow(fileDialog.data(), parent_window);
+    Request::makeClosableDialogRequest(handle, fileDialog.data());
     fileDialog->setWindowTitle(title);
     fileDialog->setModal(modalDialog);
     KFile::Mode mode = directory ? KFile::Mode::Directory : multipleFiles ? KFile::Mode::Files : KFile::Mode::File;
@@ -424,6 +426,7 @@ uint FileChooserPortal::SaveFile(const QDBusObjectPath &handle,
 
     QScopedPointer<FileDialog, QScopedPointerDeleteLater> fileDialog(new FileDialog());
     Utils::setParentWindow(fileDialog.data(), parent_window);
+    Request::makeClosableDialogRequest(handle, fileDialog.data());
     fileDialog->setWindowTitle(title);
     fileDialog->setModal(modalDialog);
     fileDialog->m_fileWidget->setOperationMode(KFileWidget::Saving);
@@ -20,19 +20,89 @@
 
 #include "inhibit.h"
 #include "request.h"
+#include "session.h"
+#include "timerwheel.h"
 
 #include <QDBusConnection>
 #include <QDBusMessage>
 #include <QDBusPendingCall>
 #include <QDBusPendingReply>
 #include <QDBusPendingCallWatcher>
+#include <QGuiApplication>
 #include <QLoggingCategory>
+#include <QSessionManager>
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeInhibit, "xdp-kde-inhibit")
 
+// Maps the portal flags (logout 1, user switch 2, suspend 4, idle 8) to PowerDevil's
+// PolicyAgent policies (interrupt session 1, change profile 2, change screen settings 4)
+static uint policiesForFlags(uint flags)
+{
+    uint policies = 0;
+    if (flags & 4) {
+        policies |= 1;
+    }
+    if (flags & 8) {
+        // Idle covers dimming and locking the screen as well as suspending on idle
+        policies |= 1 | 4;
+    }
+    return policies;
+}
+
+// Monitors get one second to respond to the query end, see the portal documentation
+static const int queryEndTimeout = 1000;
+
 InhibitPortal::InhibitPortal(QObject *parent)
     : QDBusAbstractAdaptor(parent)
+    , m_queryEndDeadlines(new TimerWheel(100, 16, this))
 {
+    connect(m_queryEndDeadlines, &TimerWheel::expired, this, [this] (const QString &sessionHandle) {
+        qCDebug(XdgDesktopPortalKdeInhibit) << "Monitor" << sessionHandle << "didn't respond to the query end in time";
+        finishQueryEnd();
+    });
+
+    QDBusConnection::systemBus().connect(QStringLiteral("org.freedesktop.login1"),
+                                         QStringLiteral("/org/freedesktop/login1"),
+                                         QStringLiteral("org.freedesktop.login1.Manager"),
+                                         QStringLiteral("PrepareForShutdown"),
+                                         this,
+                                         SLOT(prepareForShutdown(bool)));
+    takeShutdownInhibitor();
+
+    // ksmserver asks its clients to save their data before it logs out
+    connect(qApp, &QGuiApplication::commitDataRequest, this, [this] (QSessionManager &manager) {
+        // We are D-Bus activated, nothing to restore on the next login
+        manager.setRestartHint(QSessionManager::RestartNever);
+        logoutRequested(manager);
+    });
+    QDBusConnection::sessionBus().connect(QStringLiteral("org.kde.Shutdown"),
+                                          QStringLiteral("/Shutdown"),
+                                          QStringLiteral("org.kde.Shutdown"),
+                                          QStringLiteral("logoutCancelled"),
+                                          this,
+                                          SLOT(logoutCancelled()));
+
+    QDBusConnection::sessionBus().connect(QStringLiteral("org.freedesktop.ScreenSaver"),
+                                          QStringLiteral("/org/freedesktop/ScreenSaver"),
+                                          QStringLiteral("org.freedesktop.ScreenSaver"),
+                                          QStringLiteral("ActiveChanged"),
+                                          this,
+                                          SLOT(screenSaverActiveChanged(bool)));
+
+    QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.ScreenSaver"),
+                                                          QStringLiteral("/org/freedesktop/ScreenSaver"),
+                                                          QStringLiteral("org.freedesktop.ScreenSaver"),
+                                                          QStringLiteral("GetActive"));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this] (QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<bool> reply = *watcher;
+        if (reply.isError()) {
+            qCDebug(XdgDesktopPortalKdeInhibit) << "Failed to get screen saver state: " << reply.error().message();
+        } else {
+            screenSaverActiveChanged(reply.value());
+        }
+        watcher->deleteLater();
+    });
 }
 
 InhibitPortal::~InhibitPortal()
@@ -48,32 +118,314 @@ void InhibitPortal::Inhibit(const QDBusObjectPath &handle, const QString &app_id
     qCDebug(XdgDesktopPortalKdeInhibit) << "    flags: " << flags;
     qCDebug(XdgDesktopPortalKdeInhibit) << "    options: " << options;
 
+    const uint policies = policiesForFlags(flags);
+
+    Request *request = new Request(handle, this, QStringLiteral("org.freedesktop.impl.portal.Inhibit"));
+
+    // Logout and user switch can't be inhibited through PowerDevil, keep the request around anyway
+    if (!policies) {
+        connect(request, &Request::closeRequested, request, &QObject::deleteLater);
+        return;
+    }
+
+    const InhibitionKey key(app_id, policies);
+    addInhibition(key, options.value(QStringLiteral("reason")).toString());
+
+    connect(request, &Request::closeRequested, this, [this, request, key] () {
+        releaseInhibition(key);
+        request->deleteLater();
+    });
+}
+
+void InhibitPortal::addInhibition(const InhibitionKey &key, const QString &reason)
+{
+    // Later requests share the inhibition, and with it the reason of the first one
+    const bool inhibited = m_inhibitions.contains(key);
+    ++m_inhibitions[key].refCount;
+    if (inhibited) {
+        // Already inhibited upstream, or on its way
+        return;
+    }
+
     QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Solid.PowerManagement"),
                                                           QStringLiteral("/org/kde/Solid/PowerManagement/PolicyAgent"),
                                                           QStringLiteral("org.kde.Solid.PowerManagement.PolicyAgent"),
                                                           QStringLiteral("AddInhibition"));
-    //         interrupt session (1)
-    message << (uint)1 << app_id << options.value(QStringLiteral("reason")).toString();
+    message << key.second << key.first << reason;
 
-    QDBusPendingCall pendingCall = QDBusConnection::sessionBus().asyncCall(message);
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pendingCall);
-    connect(watcher, &QDBusPendingCallWatcher::finished, [handle, this] (QDBusPendingCallWatcher *watcher) {
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, key] (QDBusPendingCallWatcher *watcher) {
         QDBusPendingReply<uint> reply = *watcher;
+        watcher->deleteLater();
+
+        auto it = m_inhibitions.find(key);
+        if (it == m_inhibitions.end()) {
+            return;
+        }
+
+        it->pending = false;
+
         if (reply.isError()) {
+            // Requests still hold this key, keep the entry without a cookie until they are gone
             qCDebug(XdgDesktopPortalKdeInhibit) << "Inhibition error: " << reply.error().message();
-        } else {
-            QDBusConnection sessionBus = QDBusConnection::sessionBus();
-            Request *request = new Request(this, QStringLiteral("org.freedesktop.impl.portal.Inhibit"), QVariant(reply.value()));
-            if (sessionBus.registerVirtualObject(handle.path(), request, QDBusConnection::VirtualObjectRegisterOption::SubPath)) {
-                connect(request, &Request::closeRequested, [request, handle] () {
-                    QDBusConnection::sessionBus().unregisterObject(handle.path());
-                    request->deleteLater();
-                });
-            } else {
-                qCDebug(XdgDesktopPortalKdeInhibit) << sessionBus.lastError().message();
-                qCDebug(XdgDesktopPortalKdeInhibit) << "Failed to register request object with inhibition";
-                request->deleteLater();
+            it->failed = true;
+            if (it->refCount <= 0) {
+                m_inhibitions.erase(it);
             }
+            return;
         }
+
+        it->cookie = reply.value();
+
+        // Every request went away while we were waiting for PowerDevil
+        if (it->refCount <= 0) {
+            releaseInhibition(key);
+        }
+    });
+}
+
+void InhibitPortal::releaseInhibition(const InhibitionKey &key)
+{
+    auto it = m_inhibitions.find(key);
+    if (it == m_inhibitions.end()) {
+        return;
+    }
+
+    if (it->refCount > 0) {
+        --it->refCount;
+    }
+
+    if (it->refCount > 0 || it->pending) {
+        return;
+    }
+
+    if (it->failed) {
+        m_inhibitions.erase(it);
+        return;
+    }
+
+    QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Solid.PowerManagement"),
+                                                          QStringLiteral("/org/kde/Solid/PowerManagement/PolicyAgent"),
+                                                          QStringLiteral("org.kde.Solid.PowerManagement.PolicyAgent"),
+                                                          QStringLiteral("ReleaseInhibition"));
+    message << it->cookie;
+    m_inhibitions.erase(it);
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [] (QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<> reply = *watcher;
+        if (reply.isError()) {
+            qCDebug(XdgDesktopPortalKdeInhibit) << "Uninhibit error: " << reply.error().message();
+        }
+        watcher->deleteLater();
     });
 }
+
+uint InhibitPortal::CreateMonitor(const QDBusObjectPath &handle,
+                                  const QDBusObjectPath &session_handle,
+                                  const QString &app_id,
+                                  const QString &window)
+{
+    qCDebug(XdgDesktopPortalKdeInhibit) << "CreateMonitor called with parameters:";
+    qCDebug(XdgDesktopPortalKdeInhibit) << "    handle: " << handle.path();
+    qCDebug(XdgDesktopPortalKdeInhibit) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeInhibit) << "    app_id: " << app_id;
+    qCDebug(XdgDesktopPortalKdeInhibit) << "    window: " << window;
+
+    Session *session = Session::createSession(this, Session::InhibitMonitor, app_id, session_handle.path());
+
+    if (!session) {
+        return 2;
+    }
+
+    const QString sessionHandle = session_handle.path();
+    m_monitors.insert(sessionHandle);
+
+    connect(session, &Session::closed, this, [this, sessionHandle] () {
+        m_monitors.remove(sessionHandle);
+        if (m_queryEndDeadlines->isScheduled(sessionHandle)) {
+            m_queryEndDeadlines->cancel(sessionHandle);
+            finishQueryEnd();
+        }
+    });
+
+    // The monitor only exists for the caller once we replied, send the current state after that
+    QMetaObject::invokeMethod(this, [this, sessionHandle] () {
+        if (!m_monitors.contains(sessionHandle)) {
+            return;
+        }
+
+        notifyMonitor(sessionHandle);
+        if (m_sessionState == QueryEnd) {
+            m_queryEndDeadlines->schedule(sessionHandle, queryEndTimeout);
+        }
+    }, Qt::QueuedConnection);
+
+    return 0;
+}
+
+void InhibitPortal::QueryEndResponse(const QDBusObjectPath &session_handle)
+{
+    qCDebug(XdgDesktopPortalKdeInhibit) << "QueryEndResponse called with parameters:";
+    qCDebug(XdgDesktopPortalKdeInhibit) << "    session_handle: " << session_handle.path();
+
+    if (!m_queryEndDeadlines->isScheduled(session_handle.path())) {
+        return;
+    }
+
+    m_queryEndDeadlines->cancel(session_handle.path());
+    finishQueryEnd();
+}
+
+void InhibitPortal::takeShutdownInhibitor()
+{
+    if (m_shutdownInhibitor.isValid()) {
+        return;
+    }
+
+    QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.login1"),
+                                                          QStringLiteral("/org/freedesktop/login1"),
+                                                          QStringLiteral("org.freedesktop.login1.Manager"),
+                                                          QStringLiteral("Inhibit"));
+    message << QStringLiteral("shutdown")
+            << QStringLiteral("xdg-desktop-portal-kde")
+            << QStringLiteral("Let applications save their state")
+            << QStringLiteral("delay");
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this] (QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<QDBusUnixFileDescriptor> reply = *watcher;
+        if (reply.isError()) {
+            qCDebug(XdgDesktopPortalKdeInhibit) << "Failed to delay shutdown: " << reply.error().message();
+        } else if (m_sessionState == Running) {
+            m_shutdownInhibitor = reply.value();
+        }
+        watcher->deleteLater();
+    });
+}
+
+void InhibitPortal::prepareForShutdown(bool start)
+{
+    if (start) {
+        startQueryEnd();
+    } else {
+        cancelQueryEnd();
+    }
+}
+
+void InhibitPortal::logoutRequested(QSessionManager &manager)
+{
+    startQueryEnd();
+    if (m_sessionState != QueryEnd) {
+        return;
+    }
+
+    // ksmserver carries on with the logout as soon as we return. Rather than blocking it,
+    // cancel this one and ask for a new logout once the monitors are done. Shutdown is
+    // held back by the logind delay lock meanwhile.
+    if (manager.allowsInteraction()) {
+        m_logoutDeferred = true;
+        ++m_cancelledLogouts;
+        manager.cancel();
+    }
+}
+
+void InhibitPortal::logoutCancelled()
+{
+    if (m_cancelledLogouts > 0) {
+        --m_cancelledLogouts;
+        return;
+    }
+
+    cancelQueryEnd();
+}
+
+void InhibitPortal::startQueryEnd()
+{
+    // Logging out and shutting down can overlap, only query once
+    if (m_sessionState != Running) {
+        return;
+    }
+
+    setSessionState(QueryEnd);
+
+    for (const QString &sessionHandle : qAsConst(m_monitors)) {
+        m_queryEndDeadlines->schedule(sessionHandle, queryEndTimeout);
+    }
+
+    finishQueryEnd();
+}
+
+void InhibitPortal::cancelQueryEnd()
+{
+    m_queryEndDeadlines->clear();
+    m_logoutDeferred = false;
+    setSessionState(Running);
+    takeShutdownInhibitor();
+}
+
+void InhibitPortal::screenSaverActiveChanged(bool active)
+{
+    if (m_screenSaverActive == active) {
+        return;
+    }
+
+    m_screenSaverActive = active;
+    notifyMonitors();
+}
+
+void InhibitPortal::setSessionState(SessionState state)
+{
+    if (m_sessionState == state) {
+        return;
+    }
+
+    m_sessionState = state;
+    notifyMonitors();
+}
+
+void InhibitPortal::finishQueryEnd()
+{
+    if (m_sessionState != QueryEnd || !m_queryEndDeadlines->isEmpty()) {
+        return;
+    }
+
+    setSessionState(Ending);
+
+    // Closing our copy of the fd releases the delay lock
+    m_shutdownInhibitor = QDBusUnixFileDescriptor();
+
+    if (m_logoutDeferred) {
+        m_logoutDeferred = false;
+        // We are Ending now, this time the logout goes through
+        QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Shutdown"),
+                                                              QStringLiteral("/Shutdown"),
+                                                              QStringLiteral("org.kde.Shutdown"),
+                                                              QStringLiteral("logout"));
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this] (QDBusPendingCallWatcher *watcher) {
+            QDBusPendingReply<> reply = *watcher;
+            if (reply.isError()) {
+                qCWarning(XdgDesktopPortalKdeInhibit) << "Failed to resume the logout: " << reply.error().message();
+                cancelQueryEnd();
+            }
+            watcher->deleteLater();
+        });
+    }
+}
+
+void InhibitPortal::notifyMonitor(const QString &sessionHandle)
+{
+    QVariantMap state;
+    state.insert(QStringLiteral("screensaver-active"), m_screenSaverActive);
+    state.insert(QStringLiteral("session-state"), static_cast<uint>(m_sessionState));
+
+    Q_EMIT StateChanged(QDBusObjectPath(sessionHandle), state);
+}
+
+void InhibitPortal::notifyMonitors()
+{
+    for (const QString &sessionHandle : qAsConst(m_monitors)) {
+        notifyMonitor(sessionHandle);
+    }
+}
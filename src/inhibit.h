@@ -23,9 +23,16 @@
 
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
+#include <QDBusUnixFileDescriptor>
+#include <QHash>
+#include <QPair>
+#include <QSet>
 
 #include "request.h"
 
+class QSessionManager;
+class TimerWheel;
+
 class InhibitPortal : public QDBusAbstractAdaptor
 {
     Q_OBJECT
@@ -34,12 +41,72 @@ public:
     explicit InhibitPortal(QObject *parent);
     ~InhibitPortal();
 
+    enum SessionState {
+        Running = 1,
+        QueryEnd = 2,
+        Ending = 3
+    };
+
 public Q_SLOTS:
     void Inhibit(const QDBusObjectPath &handle,
                  const QString &app_id,
                  const QString &window,
                  uint flags,
                  const QVariantMap &options);
+
+    uint CreateMonitor(const QDBusObjectPath &handle,
+                       const QDBusObjectPath &session_handle,
+                       const QString &app_id,
+                       const QString &window);
+
+    void QueryEndResponse(const QDBusObjectPath &session_handle);
+
+Q_SIGNALS:
+    void StateChanged(const QDBusObjectPath &session_handle,
+                      const QVariantMap &state);
+
+private Q_SLOTS:
+    // Private, so they don't get exported on the bus
+    void prepareForShutdown(bool start);
+    void screenSaverActiveChanged(bool active);
+    void logoutCancelled();
+
+private:
+    // Requests of one application for the same policies share a single PowerDevil inhibition
+    typedef QPair<QString, uint> InhibitionKey;
+    struct Inhibition {
+        uint cookie = 0;
+        bool pending = true;
+        // PowerDevil refused, nothing to release once the requests are gone
+        bool failed = false;
+        int refCount = 0;
+    };
+
+    void addInhibition(const InhibitionKey &key, const QString &reason);
+    void releaseInhibition(const InhibitionKey &key);
+
+    void takeShutdownInhibitor();
+    void logoutRequested(QSessionManager &manager);
+    void startQueryEnd();
+    void cancelQueryEnd();
+    void setSessionState(SessionState state);
+    void finishQueryEnd();
+    void notifyMonitor(const QString &sessionHandle);
+    void notifyMonitors();
+
+    QHash<InhibitionKey, Inhibition> m_inhibitions;
+
+    bool m_screenSaverActive = false;
+    SessionState m_sessionState = Running;
+    QSet<QString> m_monitors;
+    // Monitors which still have to acknowledge the query end
+    TimerWheel *m_queryEndDeadlines;
+    // Delays shutdown until monitors had their chance to save state
+    QDBusUnixFileDescriptor m_shutdownInhibitor;
+    // We cancelled ksmserver's logout and ask for it again once the query end is over
+    bool m_logoutDeferred = false;
+    // logoutCancelled signals caused by us rather than the user
+    int m_cancelledLogouts = 0;
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_INHIBIT_H
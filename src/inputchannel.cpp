@@ -0,0 +1,262 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "inputchannel.h"
+#include "inputlatency.h"
+#include "inputrecorder.h"
+#include "session.h"
+#include "waylandintegration.h"
+
+#include <QLoggingCategory>
+#include <QPointer>
+#include <QSocketNotifier>
+
+#include <algorithm>
+#include <iterator>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeInputChannel, "xdp-kde-input-channel")
+
+// Lives on the channel's thread, so that decoding never waits for the main thread
+class InputChannelReader : public QObject
+{
+public:
+    InputChannelReader(int fd, InputChannel *channel)
+        : m_fd(fd)
+        , m_channel(channel)
+    {
+    }
+
+    ~InputChannelReader()
+    {
+        close(m_fd);
+    }
+
+    void start()
+    {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &InputChannelReader::read);
+    }
+
+private:
+    void read()
+    {
+        // Everything available is handed over in one go
+        InputEvent buffer[InputChannel::maxEventsPerPacket];
+        QVector<InputEvent> events;
+
+        while (true) {
+            // With MSG_TRUNC we get the real size of the packet, even if it didn't fit
+            const ssize_t size = recv(m_fd, buffer, sizeof(buffer), MSG_DONTWAIT | MSG_TRUNC);
+            if (size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                qCWarning(XdgDesktopPortalKdeInputChannel) << "Failed to read input:" << strerror(errno);
+                stop();
+                break;
+            }
+            if (size == 0) {
+                stop();
+                break;
+            }
+            if (size_t(size) > sizeof(buffer)) {
+                qCWarning(XdgDesktopPortalKdeInputChannel) << "Closing input channel, packet of" << size << "bytes exceeds the limit of" << InputChannel::maxEventsPerPacket << "events";
+                stop();
+                break;
+            }
+            if (size % sizeof(InputEvent)) {
+                qCWarning(XdgDesktopPortalKdeInputChannel) << "Dropping malformed packet of" << size << "bytes";
+                continue;
+            }
+            std::copy(buffer, buffer + size / sizeof(InputEvent), std::back_inserter(events));
+        }
+
+        if (!events.isEmpty()) {
+            QMetaObject::invokeMethod(m_channel, [channel = m_channel, events, receivedAt = InputLatency::timestamp()] {
+                channel->dispatch(events, receivedAt);
+            });
+        }
+    }
+
+    void stop()
+    {
+        m_notifier->setEnabled(false);
+        QMetaObject::invokeMethod(m_channel, &InputChannel::closed);
+    }
+
+    const int m_fd;
+    InputChannel *const m_channel;
+    QSocketNotifier *m_notifier = nullptr;
+};
+
+InputChannel::InputChannel(RemoteDesktopSession *session)
+    : QObject(session)
+    , m_session(session)
+{
+    m_thread.setObjectName(QStringLiteral("InputChannel"));
+}
+
+InputChannel::~InputChannel()
+{
+    if (m_reader) {
+        QMetaObject::invokeMethod(m_reader, [reader = m_reader] {
+            delete reader;
+        }, Qt::BlockingQueuedConnection);
+    }
+    m_thread.quit();
+    m_thread.wait();
+}
+
+QDBusUnixFileDescriptor InputChannel::open()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds) != 0) {
+        qCWarning(XdgDesktopPortalKdeInputChannel) << "Failed to create input channel:" << strerror(errno);
+        return QDBusUnixFileDescriptor();
+    }
+
+    m_reader = new InputChannelReader(fds[0], this);
+    m_reader->moveToThread(&m_thread);
+    m_thread.start();
+    QMetaObject::invokeMethod(m_reader, [reader = m_reader] {
+        reader->start();
+    });
+
+    // QDBusUnixFileDescriptor dups the fd
+    const QDBusUnixFileDescriptor clientFd(fds[1]);
+    ::close(fds[1]);
+    return clientFd;
+}
+
+static RemoteDesktopPortal::DeviceType deviceTypeForEvent(quint32 type)
+{
+    switch (type) {
+    case InputEvent::KeyboardKeycode:
+    case InputEvent::KeyboardKeysym:
+        return RemoteDesktopPortal::Keyboard;
+    case InputEvent::TouchDown:
+    case InputEvent::TouchMotion:
+    case InputEvent::TouchUp:
+        return RemoteDesktopPortal::TouchScreen;
+    default:
+        return RemoteDesktopPortal::Pointer;
+    }
+}
+
+static const char *nameForEvent(quint32 type)
+{
+    switch (type) {
+    case InputEvent::PointerMotion:
+        return "PointerMotion";
+    case InputEvent::PointerMotionAbsolute:
+        return "PointerMotionAbsolute";
+    case InputEvent::PointerButton:
+        return "PointerButton";
+    case InputEvent::PointerAxis:
+        return "PointerAxis";
+    case InputEvent::PointerAxisDiscrete:
+        return "PointerAxisDiscrete";
+    case InputEvent::KeyboardKeycode:
+        return "KeyboardKeycode";
+    case InputEvent::KeyboardKeysym:
+        return "KeyboardKeysym";
+    case InputEvent::TouchDown:
+        return "TouchDown";
+    case InputEvent::TouchMotion:
+        return "TouchMotion";
+    case InputEvent::TouchUp:
+        return "TouchUp";
+    default:
+        return "Unknown";
+    }
+}
+
+void InputChannel::dispatch(const QVector<InputEvent> &events, qint64 receivedAt)
+{
+    // Permissions are fixed once the session started, read them once per batch
+    const RemoteDesktopPortal::DeviceTypes permissions = m_session->inputPermissions();
+    if (permissions == RemoteDesktopPortal::None) {
+        return;
+    }
+
+    const QString session = m_session->path();
+    for (const InputEvent &event : events) {
+        // Recorded like the Notify* calls, rejected events don't count
+        InputLatency::Trace trace(session, nameForEvent(event.type), receivedAt);
+        if (!(permissions & deviceTypeForEvent(event.type))) {
+            continue;
+        }
+        trace.sessionFound();
+
+        InputRecorder::record(event);
+
+        switch (event.type) {
+        case InputEvent::PointerMotion:
+            WaylandIntegration::requestPointerMotion(session, QSizeF(event.x, event.y));
+            break;
+        case InputEvent::PointerMotionAbsolute:
+            if (!m_session->hasStream(event.arg)) {
+                break;
+            }
+            WaylandIntegration::requestPointerMotionAbsolute(session, event.arg, QPointF(event.x, event.y));
+            break;
+        case InputEvent::PointerButton:
+            if (event.arg2) {
+                WaylandIntegration::requestPointerButtonPress(event.arg);
+            } else {
+                WaylandIntegration::requestPointerButtonRelease(event.arg);
+            }
+            break;
+        case InputEvent::PointerAxis:
+            WaylandIntegration::requestPointerAxis(session, QSizeF(event.x, event.y), event.arg2);
+            break;
+        case InputEvent::PointerAxisDiscrete:
+            WaylandIntegration::requestPointerAxisDiscrete(!event.arg ? Qt::Vertical : Qt::Horizontal, static_cast<qint32>(event.arg2));
+            break;
+        case InputEvent::KeyboardKeycode:
+            WaylandIntegration::requestKeyboardKeycode(event.arg, event.arg2);
+            break;
+        case InputEvent::KeyboardKeysym:
+            WaylandIntegration::requestKeyboardKeysym(event.arg, event.arg2);
+            break;
+        case InputEvent::TouchDown:
+            if (!m_session->hasStream(event.arg)) {
+                break;
+            }
+            WaylandIntegration::requestTouchDown(session, event.arg, event.arg2, QPointF(event.x, event.y));
+            break;
+        case InputEvent::TouchMotion:
+            if (!m_session->hasStream(event.arg)) {
+                break;
+            }
+            WaylandIntegration::requestTouchMotion(session, event.arg, event.arg2, QPointF(event.x, event.y));
+            break;
+        case InputEvent::TouchUp:
+            WaylandIntegration::requestTouchUp(session, event.arg2);
+            break;
+        default:
+            qCDebug(XdgDesktopPortalKdeInputChannel) << "Ignoring unknown event type" << event.type;
+            break;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_INPUT_CHANNEL_H
+#define XDG_DESKTOP_PORTAL_KDE_INPUT_CHANNEL_H
+
+#include <QDBusUnixFileDescriptor>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+#include "inputevent.h"
+
+class InputChannelReader;
+class RemoteDesktopSession;
+
+// Alternative to the Notify* methods for clients sending a lot of input. Events are written
+// to a SOCK_SEQPACKET socket, each packet holds one up to maxEventsPerPacket InputEvents.
+// A larger packet closes the channel.
+class InputChannel : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int maxEventsPerPacket = 64;
+
+    explicit InputChannel(RemoteDesktopSession *session);
+    ~InputChannel();
+
+    // Returns the end to hand to the client, invalid on failure. Call only once.
+    QDBusUnixFileDescriptor open();
+
+Q_SIGNALS:
+    void closed();
+
+private:
+    void dispatch(const QVector<InputEvent> &events, qint64 receivedAt);
+
+    RemoteDesktopSession *const m_session;
+    QThread m_thread;
+    InputChannelReader *m_reader = nullptr;
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_INPUT_CHANNEL_H
@@ -0,0 +1,57 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_INPUT_EVENT_H
+#define XDG_DESKTOP_PORTAL_KDE_INPUT_EVENT_H
+
+#include <QtGlobal>
+
+// A single remote desktop input event, as sent over the input channel and stored in input
+// recordings. All fields are in host byte order. Meaning of the fields per type:
+//
+//   PointerMotion          x, y: relative motion
+//   PointerMotionAbsolute  arg: stream, x, y: position within the stream
+//   PointerButton          arg: evdev button, arg2: state
+//   PointerAxis            x, y: scroll amount, arg2: finish
+//   PointerAxisDiscrete    arg: axis, arg2: steps (signed)
+//   KeyboardKeycode        arg: evdev key code, arg2: state
+//   KeyboardKeysym         arg: keysym, arg2: state
+//   TouchDown              arg: stream, arg2: slot, x, y: position within the stream
+//   TouchMotion            arg: stream, arg2: slot, x, y: position within the stream
+//   TouchUp                arg2: slot
+struct InputEvent {
+    enum Type : quint32 {
+        PointerMotion = 1,
+        PointerMotionAbsolute,
+        PointerButton,
+        PointerAxis,
+        PointerAxisDiscrete,
+        KeyboardKeycode,
+        KeyboardKeysym,
+        TouchDown,
+        TouchMotion,
+        TouchUp
+    };
+
+    quint32 type;
+    quint32 arg;
+    quint32 arg2;
+    quint32 reserved;
+    double x;
+    double y;
+};
+static_assert(sizeof(InputEvent) == 32, "InputEvent is part of the wire format");
+
+#endif // XDG_DESKTOP_PORTAL_KDE_INPUT_EVENT_H
@@ -0,0 +1,241 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "inputlatency.h"
+#include "waylandintegration.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QStringList>
+#include <QTextStream>
+#include <QTimer>
+
+#include <array>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeInputLatency, "xdp-kde-input-latency")
+
+static const int s_bucketCount = 24;
+typedef std::array<std::array<uint, s_bucketCount>, InputLatency::StageCount> Histograms;
+
+struct InputLatencyData {
+    bool enabled = false;
+    QElapsedTimer clock;
+
+    // Main thread only
+    QString currentSession;
+    qint64 currentReceipt = 0;
+
+    // Shared with the Wayland thread
+    QMutex mutex;
+    QHash<QString, Histograms> histograms;
+    QFile traceFile;
+    QTextStream trace;
+};
+Q_GLOBAL_STATIC(InputLatencyData, latencyData)
+
+// Callers hold the mutex
+static void record(Histograms &histograms, InputLatency::Stage stage, qint64 nanoseconds)
+{
+    const qint64 microseconds = qMax<qint64>(0, nanoseconds / 1000);
+    int bucket = 0;
+    while (bucket < s_bucketCount - 1 && (qint64(1) << bucket) <= microseconds) {
+        ++bucket;
+    }
+
+    ++histograms[stage][bucket];
+}
+
+static void flushTrace()
+{
+    QMutexLocker locker(&latencyData->mutex);
+    latencyData->trace.flush();
+}
+
+void InputLatency::init()
+{
+    const QString tracePath = qEnvironmentVariable("XDG_DESKTOP_PORTAL_KDE_INPUT_TRACE");
+    if (!qEnvironmentVariableIsSet("XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY") && tracePath.isEmpty()) {
+        return;
+    }
+
+    latencyData->enabled = true;
+    latencyData->clock.start();
+
+    if (!tracePath.isEmpty()) {
+        latencyData->traceFile.setFileName(tracePath);
+        if (latencyData->traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            latencyData->trace.setDevice(&latencyData->traceFile);
+            latencyData->trace << "# session event receipt_ns lookup_ns dispatch_ns flush_ns\n";
+
+            // Writing out every event would keep the Wayland thread waiting on the mutex
+            QTimer *flushTimer = new QTimer(QCoreApplication::instance());
+            QObject::connect(flushTimer, &QTimer::timeout, flushTrace);
+            flushTimer->start(1000);
+            QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, flushTrace);
+        } else {
+            qCWarning(XdgDesktopPortalKdeInputLatency) << "Failed to open trace file" << tracePath << latencyData->traceFile.errorString();
+        }
+    }
+
+    QObject *object = new QObject(QCoreApplication::instance());
+    new InputLatencyAdaptor(object);
+    if (!QDBusConnection::sessionBus().registerObject(QStringLiteral("/org/kde/XdgDesktopPortalKde/InputLatency"), object, QDBusConnection::ExportAdaptors)) {
+        qCWarning(XdgDesktopPortalKdeInputLatency) << "Failed to register the input latency interface";
+    }
+}
+
+bool InputLatency::isEnabled()
+{
+    return latencyData->enabled;
+}
+
+qint64 InputLatency::timestamp()
+{
+    return latencyData->enabled ? latencyData->clock.nsecsElapsed() : 0;
+}
+
+QString InputLatency::currentSession()
+{
+    return latencyData->currentSession;
+}
+
+qint64 InputLatency::currentReceipt()
+{
+    return latencyData->currentReceipt;
+}
+
+void InputLatency::recordFlush(const QString &session, qint64 receivedAt, qint64 queuedAt)
+{
+    if (!latencyData->enabled || !receivedAt) {
+        return;
+    }
+
+    const qint64 flushedAt = timestamp();
+
+    QMutexLocker locker(&latencyData->mutex);
+    // Don't bring back a session which was closed while its events were on their way
+    const auto it = latencyData->histograms.find(session);
+    if (it != latencyData->histograms.end()) {
+        record(*it, Flush, flushedAt - queuedAt);
+        record(*it, Total, flushedAt - receivedAt);
+    }
+    if (latencyData->trace.device()) {
+        latencyData->trace << session << " flush " << receivedAt << " - " << queuedAt << ' ' << flushedAt << '\n';
+    }
+}
+
+void InputLatency::removeSession(const QString &session)
+{
+    if (!latencyData->enabled) {
+        return;
+    }
+
+    QMutexLocker locker(&latencyData->mutex);
+    latencyData->histograms.remove(session);
+}
+
+InputLatency::Trace::Trace(const QString &session, const char *method)
+    : Trace(session, method, timestamp())
+{
+}
+
+InputLatency::Trace::Trace(const QString &session, const char *method, qint64 receivedAt)
+    : m_method(method)
+{
+    if (latencyData->enabled) {
+        latencyData->currentSession = session;
+        latencyData->currentReceipt = receivedAt;
+    }
+}
+
+InputLatency::Trace::~Trace()
+{
+    if (!latencyData->enabled) {
+        return;
+    }
+
+    const qint64 dispatchedAt = timestamp();
+    const qint64 receivedAt = latencyData->currentReceipt;
+    const QString session = latencyData->currentSession;
+    latencyData->currentSession.clear();
+    latencyData->currentReceipt = 0;
+
+    // Calls on unknown sessions are not interesting
+    if (!m_sessionFound) {
+        return;
+    }
+
+    QMutexLocker locker(&latencyData->mutex);
+    Histograms &histograms = latencyData->histograms[session];
+    record(histograms, Lookup, m_sessionFound - receivedAt);
+    record(histograms, Dispatch, dispatchedAt - m_sessionFound);
+    if (latencyData->trace.device()) {
+        latencyData->trace << session << ' ' << m_method << ' ' << receivedAt << ' ' << m_sessionFound << ' ' << dispatchedAt << " -\n";
+    }
+}
+
+void InputLatency::Trace::sessionFound()
+{
+    m_sessionFound = timestamp();
+}
+
+InputLatencyAdaptor::InputLatencyAdaptor(QObject *parent)
+    : QDBusAbstractAdaptor(parent)
+{
+}
+
+QStringList InputLatencyAdaptor::Sessions() const
+{
+    QMutexLocker locker(&latencyData->mutex);
+    return latencyData->histograms.keys();
+}
+
+QList<uint> InputLatencyAdaptor::Histogram(const QString &session, uint stage) const
+{
+    if (stage >= InputLatency::StageCount) {
+        return {};
+    }
+
+    QMutexLocker locker(&latencyData->mutex);
+    const auto it = latencyData->histograms.constFind(session);
+    if (it == latencyData->histograms.constEnd()) {
+        return {};
+    }
+
+    const auto &buckets = (*it)[stage];
+    return QList<uint>(buckets.cbegin(), buckets.cend());
+}
+
+QVariantMap InputLatencyAdaptor::Statistics() const
+{
+    const WaylandIntegration::InputStatistics statistics = WaylandIntegration::inputStatistics();
+    return {
+        {QStringLiteral("pointer-motion-events"), statistics.pointerMotionEvents},
+        {QStringLiteral("pointer-motion-events-merged"), statistics.pointerMotionEventsMerged},
+        {QStringLiteral("touch-motion-events"), statistics.touchMotionEvents},
+        {QStringLiteral("touch-motion-events-merged"), statistics.touchMotionEventsMerged}
+    };
+}
+
+void InputLatencyAdaptor::Reset()
+{
+    QMutexLocker locker(&latencyData->mutex);
+    latencyData->histograms.clear();
+}
@@ -0,0 +1,90 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY_H
+#define XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY_H
+
+#include <QDBusAbstractAdaptor>
+#include <QString>
+
+// Measures how long remote desktop input takes from arriving over D-Bus until it is flushed
+// to the compositor. Disabled unless XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY is set, or
+// XDG_DESKTOP_PORTAL_KDE_INPUT_TRACE names a file every event gets written to.
+class InputLatency
+{
+public:
+    enum Stage {
+        // Receipt until the session was looked up, for the input channel this includes
+        // handing the packet from the reader thread to the main thread
+        Lookup = 0,
+        // Session lookup until WaylandIntegration was asked to send the event
+        Dispatch,
+        // Hand over to WaylandIntegration until the Wayland connection was flushed
+        Flush,
+        // Receipt until flush
+        Total,
+        StageCount
+    };
+
+    // Keeps the time stamps of a single Notify* call, the event is recorded on destruction
+    class Trace
+    {
+    public:
+        Trace(const QString &session, const char *method);
+        // For events which arrived earlier, e.g. read by the input channel's thread
+        Trace(const QString &session, const char *method, qint64 receivedAt);
+        ~Trace();
+
+        void sessionFound();
+
+    private:
+        const char *m_method;
+        qint64 m_sessionFound = 0;
+    };
+
+    static void init();
+    static bool isEnabled();
+
+    // Monotonic nanoseconds, 0 when disabled
+    static qint64 timestamp();
+
+    // Session and receipt time of the Notify* call currently being handled on the main thread
+    static QString currentSession();
+    static qint64 currentReceipt();
+
+    // Called from the Wayland thread
+    static void recordFlush(const QString &session, qint64 receivedAt, qint64 queuedAt);
+
+    // Drops the histograms of a session which was closed
+    static void removeSession(const QString &session);
+};
+
+class InputLatencyAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.XdgDesktopPortalKde.InputLatency")
+public:
+    explicit InputLatencyAdaptor(QObject *parent);
+
+public Q_SLOTS:
+    QStringList Sessions() const;
+    // Counts per power of two microseconds, bucket n holds latencies below 2^n µs
+    QList<uint> Histogram(const QString &session, uint stage) const;
+    // Input event counters of WaylandIntegration, e.g. how much motion was merged
+    QVariantMap Statistics() const;
+    void Reset();
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY_H
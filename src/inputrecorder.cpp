@@ -0,0 +1,57 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "inputrecorder.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeInputRecorder, "xdp-kde-input-recorder")
+
+struct InputRecorderData {
+    QFile file;
+    QElapsedTimer clock;
+};
+Q_GLOBAL_STATIC(InputRecorderData, recorderData)
+
+void InputRecorder::init()
+{
+    const QString path = qEnvironmentVariable("XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDING");
+    if (path.isEmpty()) {
+        return;
+    }
+
+    recorderData->file.setFileName(path);
+    if (!recorderData->file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(XdgDesktopPortalKdeInputRecorder) << "Failed to open input recording" << path << recorderData->file.errorString();
+        return;
+    }
+
+    recorderData->file.write(InputRecording::magic, sizeof(InputRecording::magic));
+    recorderData->clock.start();
+    qCDebug(XdgDesktopPortalKdeInputRecorder) << "Recording input to" << path;
+}
+
+void InputRecorder::record(const InputEvent &event)
+{
+    if (!recorderData->file.isOpen()) {
+        return;
+    }
+
+    const InputRecording::Record record{recorderData->clock.nsecsElapsed(), event};
+    // QFile buffers and flushes on its own, a crash loses only the last few events
+    recorderData->file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+}
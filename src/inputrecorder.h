@@ -0,0 +1,43 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDER_H
+#define XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDER_H
+
+#include "inputevent.h"
+
+// Writes all remote desktop input to the file named by XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDING,
+// to be played back by xdp-kde-input-replay. The file starts with InputRecording::magic,
+// followed by InputRecording::Record entries.
+namespace InputRecording
+{
+static const char magic[8] = {'X', 'D', 'P', 'K', 'I', 'N', 'P', '1'};
+
+struct Record {
+    // Monotonic nanoseconds since the recording started
+    qint64 timestamp;
+    InputEvent event;
+};
+static_assert(sizeof(Record) == 40, "InputRecording::Record is part of the file format");
+}
+
+class InputRecorder
+{
+public:
+    static void init();
+    static void record(const InputEvent &event);
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDER_H
@@ -0,0 +1,127 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "keymap.h"
+
+#include <QLoggingCategory>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include <memory>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeKeymap, "xdp-kde-keymap")
+
+// xkb key codes are evdev key codes shifted by 8
+static const xkb_keycode_t s_evdevOffset = 8;
+
+struct XkbDeleter {
+    void operator()(xkb_context *context) const { xkb_context_unref(context); }
+    void operator()(xkb_keymap *keymap) const { xkb_keymap_unref(keymap); }
+    void operator()(xkb_state *state) const { xkb_state_unref(state); }
+};
+
+bool Keymap::load(int fd, quint32 size)
+{
+    char *map = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (map == MAP_FAILED) {
+        qCWarning(XdgDesktopPortalKdeKeymap) << "Failed to map the keymap";
+        return false;
+    }
+
+    std::unique_ptr<xkb_context, XkbDeleter> context(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
+    std::unique_ptr<xkb_keymap, XkbDeleter> keymap(context ? xkb_keymap_new_from_string(context.get(), map, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS) : nullptr);
+    munmap(map, size);
+    if (!keymap) {
+        qCWarning(XdgDesktopPortalKdeKeymap) << "Failed to compile the keymap";
+        return false;
+    }
+
+    const xkb_keycode_t minKeycode = xkb_keymap_min_keycode(keymap.get());
+    const xkb_keycode_t maxKeycode = xkb_keymap_max_keycode(keymap.get());
+
+    // Find out which key sets which modifier by pressing every key once
+    QHash<xkb_mod_mask_t, xkb_keycode_t> modifierKeys;
+    for (xkb_keycode_t keycode = minKeycode; keycode <= maxKeycode; ++keycode) {
+        std::unique_ptr<xkb_state, XkbDeleter> state(xkb_state_new(keymap.get()));
+        xkb_state_update_key(state.get(), keycode, XKB_KEY_DOWN);
+        const xkb_mod_mask_t mask = xkb_state_serialize_mods(state.get(), XKB_STATE_MODS_DEPRESSED);
+        if (!mask || modifierKeys.contains(mask)) {
+            continue;
+        }
+
+        // Lock and latch keys, e.g. Caps_Lock and Num_Lock, also set depressed modifiers while
+        // held, but stay active after the release. Only take plain modifiers.
+        xkb_state_update_key(state.get(), keycode, XKB_KEY_UP);
+        if (!xkb_state_serialize_mods(state.get(), static_cast<xkb_state_component>(XKB_STATE_MODS_LOCKED | XKB_STATE_MODS_LATCHED))) {
+            modifierKeys.insert(mask, keycode);
+        }
+    }
+
+    QHash<quint32, Key> keys;
+    for (xkb_keycode_t keycode = minKeycode; keycode <= maxKeycode; ++keycode) {
+        const xkb_level_index_t levels = xkb_keymap_num_levels_for_key(keymap.get(), keycode, 0);
+        for (xkb_level_index_t level = 0; level < levels; ++level) {
+            const xkb_keysym_t *syms = nullptr;
+            const int symCount = xkb_keymap_key_get_syms_by_level(keymap.get(), keycode, 0, level, &syms);
+            if (symCount != 1 || keys.contains(syms[0])) {
+                continue;
+            }
+
+            xkb_mod_mask_t masks[8];
+            const size_t maskCount = xkb_keymap_key_get_mods_for_level(keymap.get(), keycode, 0, level, masks, 8);
+            if (maskCount == 0) {
+                continue;
+            }
+
+            // Any of the masks produces the level, the first one we can press entirely will do
+            for (size_t i = 0; i < maskCount; ++i) {
+                Key key;
+                key.keycode = keycode - s_evdevOffset;
+
+                bool complete = true;
+                for (xkb_mod_mask_t remaining = masks[i]; remaining; remaining &= remaining - 1) {
+                    const auto modifierKey = modifierKeys.constFind(remaining & -remaining);
+                    if (modifierKey == modifierKeys.constEnd()) {
+                        complete = false;
+                        break;
+                    }
+                    key.modifiers.append(*modifierKey - s_evdevOffset);
+                }
+
+                if (complete) {
+                    keys.insert(syms[0], key);
+                    break;
+                }
+            }
+        }
+    }
+
+    qCDebug(XdgDesktopPortalKdeKeymap) << "Loaded keymap with" << keys.count() << "keysyms";
+    m_keys = keys;
+    return true;
+}
+
+std::optional<Keymap::Key> Keymap::lookup(quint32 keysym) const
+{
+    const auto it = m_keys.constFind(keysym);
+    if (it == m_keys.constEnd()) {
+        return std::nullopt;
+    }
+    return *it;
+}
@@ -0,0 +1,44 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_KEYMAP_H
+#define XDG_DESKTOP_PORTAL_KDE_KEYMAP_H
+
+#include <QHash>
+#include <QVector>
+
+#include <optional>
+
+// Reverse lookup table of the compositor's keymap, tells which key and which modifiers
+// have to be pressed to produce a given keysym with the first layout
+class Keymap
+{
+public:
+    struct Key {
+        // Linux evdev key codes, as FakeInput wants them
+        quint32 keycode = 0;
+        QVector<quint32> modifiers;
+    };
+
+    // Takes ownership of fd, as sent in wl_keyboard.keymap
+    bool load(int fd, quint32 size);
+
+    std::optional<Key> lookup(quint32 keysym) const;
+
+private:
+    QHash<quint32, Key> m_keys;
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_KEYMAP_H
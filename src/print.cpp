@@ -19,6 +19,7 @@
  */
 
 #include "print.h"
+#include "request.h"
 #include "utils.h"
 
 #include <KProcess>
@@ -602,6 +603,7 @@ uint PrintPortal::PreparePrint(const QDBusObjectPath &handle,
 
     QPrintDialog *printDialog = new QPrintDialog(printer);
     Utils::setParentWindow(printDialog, parent_window);
+    Request::makeClosableDialogRequest(handle, printDialog);
 
     // Process options
 
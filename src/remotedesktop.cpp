@@ -19,11 +19,15 @@
  */
 
 #include "remotedesktop.h"
+#include "inputlatency.h"
+#include "inputrecorder.h"
 #include "session.h"
 #include "remotedesktopdialog.h"
 #include "utils.h"
 #include "waylandintegration.h"
 
+#include <QDBusContext>
+#include <QDBusMessage>
 #include <QLoggingCategory>
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeRemoteDesktop, "xdp-kde-remotedesktop")
@@ -55,10 +59,6 @@ uint RemoteDesktopPortal::CreateSession(const QDBusObjectPath &handle,
         return 2;
     }
 
-    connect(session, &Session::closed, [] () {
-        WaylandIntegration::stopAllStreaming();
-    });
-
     if (!WaylandIntegration::isStreamingAvailable()) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "zkde_screencast_unstable_v1 does not seem to be available";
         return 2;
@@ -84,7 +84,7 @@ uint RemoteDesktopPortal::SelectDevices(const QDBusObjectPath &handle,
         types = static_cast<RemoteDesktopPortal::DeviceTypes>(options.value(QStringLiteral("types")).toUInt());
     }
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to select sources on non-existing session " << session_handle.path();
@@ -113,15 +113,43 @@ uint RemoteDesktopPortal::Start(const QDBusObjectPath &handle,
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    parent_window: " << parent_window;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call start on non-existing session " << session_handle.path();
         return 2;
     }
 
+    // Headless remote desktop: stream a virtual output instead of asking which screen to share
+    if (session->screenSharingEnabled() && session->sourceTypes() == ScreenCastPortal::Virtual) {
+        QScopedPointer<RemoteDesktopDialog, QScopedPointerDeleteLater> remoteDesktopDialog(new RemoteDesktopDialog(app_id, session->deviceTypes(), false, false));
+        Utils::setParentWindow(remoteDesktopDialog.data(), parent_window);
+
+        connect(session, &Session::closed, remoteDesktopDialog.data(), &RemoteDesktopDialog::reject);
+
+        if (!remoteDesktopDialog->exec()) {
+            return 1;
+        }
+
+        const WaylandIntegration::Streams streams = WaylandIntegration::startStreamingVirtualOutput(session->virtualOutputName(), session->virtualOutputSize(), session->virtualOutputScale(), session->cursorMode());
+
+        if (streams.isEmpty()) {
+            qCWarning(XdgDesktopPortalKdeRemoteDesktop()) << "Failed to create a virtual output";
+            return 2;
+        }
+
+        session->addStreams(streams);
+        session->setInputPermissions(remoteDesktopDialog->deviceTypes());
+        WaylandIntegration::authenticate();
+
+        results.insert(QStringLiteral("streams"), QVariant::fromValue<WaylandIntegration::Streams>(session->streams()));
+        results.insert(QStringLiteral("devices"), QVariant::fromValue<uint>(remoteDesktopDialog->deviceTypes()));
+
+        return 0;
+    }
+
     // TODO check whether we got some outputs?
-    if (WaylandIntegration::screens().isEmpty()) {
+    if (WaylandIntegration::screens()->isEmpty()) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Failed to show dialog as there is no screen to select";
         return 2;
     }
@@ -133,23 +161,21 @@ uint RemoteDesktopPortal::Start(const QDBusObjectPath &handle,
 
     if (remoteDesktopDialog->exec()) {
         if (session->screenSharingEnabled()) {
-            if (!WaylandIntegration::startStreamingOutput(remoteDesktopDialog->selectedScreens().first(), Screencasting::Hidden)) {
-                return 2;
-            }
-
-            WaylandIntegration::authenticate();
+            const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming({remoteDesktopDialog->selectedScreens().first()}, {}, session->cursorMode());
 
-            QVariant streams = WaylandIntegration::streams();
-
-            if (!streams.isValid()) {
+            if (streams.isEmpty()) {
                 qCWarning(XdgDesktopPortalKdeRemoteDesktop()) << "Pipewire stream is not ready to be streamed";
                 return 2;
             }
 
-            results.insert(QStringLiteral("streams"), streams);
+            session->addStreams(streams);
+            session->setInputPermissions(remoteDesktopDialog->deviceTypes());
+            WaylandIntegration::authenticate();
+
+            results.insert(QStringLiteral("streams"), QVariant::fromValue<WaylandIntegration::Streams>(session->streams()));
         } else {
             qCWarning(XdgDesktopPortalKdeRemoteDesktop()) << "Only stream input";
-            WaylandIntegration::startStreamingInput();
+            session->setInputPermissions(remoteDesktopDialog->deviceTypes());
             WaylandIntegration::authenticate();
         }
 
@@ -161,25 +187,75 @@ uint RemoteDesktopPortal::Start(const QDBusObjectPath &handle,
     return 1;
 }
 
+uint RemoteDesktopPortal::ConnectToInputChannel(const QDBusObjectPath &session_handle,
+                                                const QString &app_id,
+                                                const QVariantMap &options,
+                                                QDBusUnixFileDescriptor &fd)
+{
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "ConnectToInputChannel called with parameters:";
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    app_id: " << app_id;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call ConnectToInputChannel on non-existing session " << session_handle.path();
+        return 2;
+    }
+
+    // The adaptor's calls carry their D-Bus context on the parent object
+    QDBusContext *context = reinterpret_cast<QDBusContext *>(QObject::parent()->qt_metacast("QDBusContext"));
+    if (!context || !context->calledFromDBus()) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Failed to get dbus context";
+        return 2;
+    }
+
+    // Anyone on the bus can reach us here, unlike the other methods which only the portal frontend calls
+    if (context->message().service() != session->owner() || app_id != session->appId()) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Refusing input channel for session " << session_handle.path() << " to " << context->message().service() << app_id;
+        return 2;
+    }
+
+    if (!session->isInputEnabled()) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to connect an input channel to a session without input " << session_handle.path();
+        return 2;
+    }
+
+    fd = session->openInputChannel();
+
+    return fd.isValid() ? 0 : 2;
+}
+
 void RemoteDesktopPortal::NotifyPointerMotion(const QDBusObjectPath &session_handle,
                                               const QVariantMap &options,
                                               double dx,
                                               double dy)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyPointerMotion");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyPointerMotion called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    dx: " << dx;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    dy: " << dy;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerMotion on non-existing session " << session_handle.path();
         return;
     }
 
-    WaylandIntegration::requestPointerMotion(QSizeF(dx, dy));
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Pointer)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::PointerMotion, 0, 0, 0, dx, dy});
+
+    WaylandIntegration::requestPointerMotion(session_handle.path(), QSizeF(dx, dy));
 }
 
 void RemoteDesktopPortal::NotifyPointerMotionAbsolute(const QDBusObjectPath &session_handle,
@@ -188,6 +264,8 @@ void RemoteDesktopPortal::NotifyPointerMotionAbsolute(const QDBusObjectPath &ses
                                                       double x,
                                                       double y)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyPointerMotionAbsolute");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyPointerMotionAbsolute called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
@@ -195,14 +273,28 @@ void RemoteDesktopPortal::NotifyPointerMotionAbsolute(const QDBusObjectPath &ses
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    x: " << x;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    y: " << y;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerMotionAbsolute on non-existing session " << session_handle.path();
         return;
     }
 
-    WaylandIntegration::requestPointerMotionAbsolute(QPointF(x, y));
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Pointer)) {
+        return;
+    }
+
+    // Stream node ids are global, don't let a session aim at another session's stream
+    if (!session->hasStream(stream)) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerMotionAbsolute on a stream not part of session " << session_handle.path();
+        return;
+    }
+
+    InputRecorder::record({InputEvent::PointerMotionAbsolute, stream, 0, 0, x, y});
+
+    WaylandIntegration::requestPointerMotionAbsolute(session_handle.path(), stream, QPointF(x, y));
 }
 
 void RemoteDesktopPortal::NotifyPointerButton(const QDBusObjectPath &session_handle,
@@ -210,19 +302,29 @@ void RemoteDesktopPortal::NotifyPointerButton(const QDBusObjectPath &session_han
                                               int button,
                                               uint state)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyPointerButton");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyPointerButton called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    button: " << button;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    state: " << state;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerButton on non-existing session " << session_handle.path();
         return;
     }
 
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Pointer)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::PointerButton, static_cast<quint32>(button), state, 0, 0, 0});
+
     if (state) {
         WaylandIntegration::requestPointerButtonPress(button);
     } else {
@@ -235,11 +337,30 @@ void RemoteDesktopPortal::NotifyPointerAxis(const QDBusObjectPath &session_handl
                                             double dx,
                                             double dy)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyPointerAxis");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyPointerAxis called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    dx: " << dx;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    dy: " << dy;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerAxis on non-existing session " << session_handle.path();
+        return;
+    }
+
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Pointer)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::PointerAxis, 0, options.value(QStringLiteral("finish")).toBool(), 0, dx, dy});
+
+    WaylandIntegration::requestPointerAxis(session_handle.path(), QSizeF(dx, dy), options.value(QStringLiteral("finish")).toBool());
 }
 
 void RemoteDesktopPortal::NotifyPointerAxisDiscrete(const QDBusObjectPath &session_handle,
@@ -247,19 +368,29 @@ void RemoteDesktopPortal::NotifyPointerAxisDiscrete(const QDBusObjectPath &sessi
                                                     uint axis,
                                                     int steps)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyPointerAxisDiscrete");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyPointerAxisDiscrete called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    axis: " << axis;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    steps: " << steps;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyPointerAxisDiscrete on non-existing session " << session_handle.path();
         return;
     }
 
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Pointer)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::PointerAxisDiscrete, axis, static_cast<quint32>(steps), 0, 0, 0});
+
     WaylandIntegration::requestPointerAxisDiscrete(!axis ? Qt::Vertical : Qt::Horizontal, steps);
 }
 
@@ -268,6 +399,30 @@ void RemoteDesktopPortal::NotifyKeyboardKeysym(const QDBusObjectPath &session_ha
                                                int keysym,
                                                uint state)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyKeyboardKeysym");
+
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyKeyboardKeysym called with parameters:";
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    keysym: " << keysym;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    state: " << state;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyKeyboardKeysym on non-existing session " << session_handle.path();
+        return;
+    }
+
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Keyboard)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::KeyboardKeysym, static_cast<quint32>(keysym), state, 0, 0, 0});
+
+    WaylandIntegration::requestKeyboardKeysym(keysym, state != 0);
 }
 
 void RemoteDesktopPortal::NotifyKeyboardKeycode(const QDBusObjectPath &session_handle,
@@ -275,19 +430,29 @@ void RemoteDesktopPortal::NotifyKeyboardKeycode(const QDBusObjectPath &session_h
                                                 int keycode,
                                                 uint state)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyKeyboardKeycode");
+
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyKeyboardKeycode called with parameters:";
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    keycode: " << keycode;
     qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    state: " << state;
 
-    RemoteDesktopSession *session = qobject_cast<RemoteDesktopSession*>(Session::getSession(session_handle.path()));
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
 
     if (!session) {
         qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyKeyboardKeycode on non-existing session " << session_handle.path();
         return;
     }
 
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::Keyboard)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::KeyboardKeycode, static_cast<quint32>(keycode), state, 0, 0, 0});
+
     WaylandIntegration::requestKeyboardKeycode(keycode, state != 0);
 }
 
@@ -295,22 +460,109 @@ void RemoteDesktopPortal::NotifyTouchDown(const QDBusObjectPath &session_handle,
                                           const QVariantMap &options,
                                           uint stream,
                                           uint slot,
-                                          int x,
-                                          int y)
+                                          double x,
+                                          double y)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyTouchDown");
+
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyTouchDown called with parameters:";
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    stream: " << stream;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    slot: " << slot;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    x: " << x;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    y: " << y;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyTouchDown on non-existing session " << session_handle.path();
+        return;
+    }
+
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::TouchScreen)) {
+        return;
+    }
+
+    // Stream node ids are global, don't let a session aim at another session's stream
+    if (!session->hasStream(stream)) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyTouchDown on a stream not part of session " << session_handle.path();
+        return;
+    }
+
+    InputRecorder::record({InputEvent::TouchDown, stream, slot, 0, x, y});
+
+    WaylandIntegration::requestTouchDown(session_handle.path(), stream, slot, QPointF(x, y));
 }
 
 void RemoteDesktopPortal::NotifyTouchMotion(const QDBusObjectPath &session_handle,
                                             const QVariantMap &options,
                                             uint stream,
                                             uint slot,
-                                            int x,
-                                            int y)
+                                            double x,
+                                            double y)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyTouchMotion");
+
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyTouchMotion called with parameters:";
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    stream: " << stream;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    slot: " << slot;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    x: " << x;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    y: " << y;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyTouchMotion on non-existing session " << session_handle.path();
+        return;
+    }
+
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::TouchScreen)) {
+        return;
+    }
+
+    // Stream node ids are global, don't let a session aim at another session's stream
+    if (!session->hasStream(stream)) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyTouchMotion on a stream not part of session " << session_handle.path();
+        return;
+    }
+
+    InputRecorder::record({InputEvent::TouchMotion, stream, slot, 0, x, y});
+
+    WaylandIntegration::requestTouchMotion(session_handle.path(), stream, slot, QPointF(x, y));
 }
 
 void RemoteDesktopPortal::NotifyTouchUp(const QDBusObjectPath &session_handle,
                                         const QVariantMap &options,
                                         uint slot)
 {
+    InputLatency::Trace trace(session_handle.path(), "NotifyTouchUp");
+
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "NotifyTouchUp called with parameters:";
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    session_handle: " << session_handle.path();
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    options: " << options;
+    qCDebug(XdgDesktopPortalKdeRemoteDesktop) << "    slot: " << slot;
+
+    RemoteDesktopSession *session = Session::getRemoteDesktopSession(session_handle.path());
+
+    if (!session) {
+        qCWarning(XdgDesktopPortalKdeRemoteDesktop) << "Tried to call NotifyTouchUp on non-existing session " << session_handle.path();
+        return;
+    }
+
+    trace.sessionFound();
+
+    if (!session->isInputAllowed(RemoteDesktopPortal::TouchScreen)) {
+        return;
+    }
+
+    InputRecorder::record({InputEvent::TouchUp, 0, slot, 0, 0, 0});
+
+    WaylandIntegration::requestTouchUp(session_handle.path(), slot);
 }
@@ -23,6 +23,7 @@
 
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
+#include <QDBusUnixFileDescriptor>
 
 
 class RemoteDesktopPortal : public QDBusAbstractAdaptor
@@ -65,6 +66,15 @@ public Q_SLOTS:
                const QVariantMap &options,
                QVariantMap &results);
 
+    // Not part of the portal specification: hands out a socket carrying the same events as
+    // the Notify* methods, without a D-Bus call per event. See InputChannel for the format.
+    // xdg-desktop-portal doesn't forward this, clients call org.freedesktop.impl.portal.desktop.kde
+    // directly. Only the client owning the session may connect, with the session's app id.
+    uint ConnectToInputChannel(const QDBusObjectPath &session_handle,
+                               const QString &app_id,
+                               const QVariantMap &options,
+                               QDBusUnixFileDescriptor &fd);
+
     void NotifyPointerMotion(const QDBusObjectPath &session_handle,
                              const QVariantMap &options,
                              double dx,
@@ -105,15 +115,15 @@ public Q_SLOTS:
                          const QVariantMap &options,
                          uint stream,
                          uint slot,
-                         int x,
-                         int y);
+                         double x,
+                         double y);
 
     void NotifyTouchMotion(const QDBusObjectPath &session_handle,
                            const QVariantMap &options,
                            uint stream,
                            uint slot,
-                           int x,
-                           int y);
+                           double x,
+                           double y);
 
     void NotifyTouchUp(const QDBusObjectPath &session_handle,
                        const QVariantMap &options,
@@ -20,10 +20,9 @@
 
 #include "remotedesktopdialog.h"
 #include "ui_remotedesktopdialog.h"
+#include "utils.h"
 
 #include <QLoggingCategory>
-#include <QStandardPaths>
-#include <QSettings>
 #include <QPushButton>
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeRemoteDesktopDialog, "xdp-kde-remote-desktop-dialog")
@@ -45,7 +44,9 @@ RemoteDesktopDialog::RemoteDesktopDialog(const QString &appName, RemoteDesktopPo
     }
 
 
-    m_dialog->screenCastWidget->itemAt(0, 0)->setSelected(true);
+    if (QListWidgetItem *firstScreen = m_dialog->screenCastWidget->item(0)) {
+        firstScreen->setSelected(true);
+    }
 
     m_dialog->keyboardCheckbox->setChecked(deviceTypes.testFlag(RemoteDesktopPortal::Keyboard));
     m_dialog->pointerCheckbox->setChecked(deviceTypes.testFlag(RemoteDesktopPortal::Pointer));
@@ -56,22 +57,7 @@ RemoteDesktopDialog::RemoteDesktopDialog(const QString &appName, RemoteDesktopPo
 
     m_dialog->buttonBox->button(QDialogButtonBox::Ok)->setText(i18n("Share"));
 
-    QString applicationName;
-    const QString desktopFile = appName + QLatin1String(".desktop");
-    const QStringList desktopFileLocations = QStandardPaths::locateAll(QStandardPaths::ApplicationsLocation, desktopFile, QStandardPaths::LocateFile);
-    for (const QString &location : desktopFileLocations) {
-        QSettings settings(location, QSettings::IniFormat);
-        settings.beginGroup(QStringLiteral("Desktop Entry"));
-        if (settings.contains(QStringLiteral("X-GNOME-FullName"))) {
-            applicationName = settings.value(QStringLiteral("X-GNOME-FullName")).toString();
-        } else {
-            applicationName = settings.value(QStringLiteral("Name")).toString();
-        }
-
-        if (!applicationName.isEmpty()) {
-            break;
-        }
-    }
+    const QString applicationName = Utils::applicationName(appName);
 
     if (applicationName.isEmpty()) {
         setWindowTitle(i18n("Select what to share with the requesting application"));
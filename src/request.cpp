@@ -22,9 +22,6 @@
 
 #include <QDBusConnection>
 #include <QDBusMessage>
-#include <QDBusPendingCall>
-#include <QDBusPendingReply>
-#include <QDBusPendingCallWatcher>
 #include <QLoggingCategory>
 
 Q_LOGGING_CATEGORY(XdgRequestKdeRequest, "xdp-kde-request")
@@ -36,44 +33,38 @@ Request::Request(QObject *parent, const QString &portalName, const QVariant &dat
 {
 }
 
+Request::Request(const QDBusObjectPath &handle, QObject *parent, const QString &portalName, const QVariant &data)
+    : Request(parent, portalName, data)
+{
+    QDBusConnection sessionBus = QDBusConnection::sessionBus();
+    if (sessionBus.registerVirtualObject(handle.path(), this, QDBusConnection::VirtualObjectRegisterOption::SubPath)) {
+        m_path = handle.path();
+    } else {
+        qCDebug(XdgRequestKdeRequest) << sessionBus.lastError().message();
+        qCDebug(XdgRequestKdeRequest) << "Failed to register request object: " << handle.path();
+    }
+}
+
 Request::~Request()
 {
+    if (!m_path.isEmpty()) {
+        QDBusConnection::sessionBus().unregisterObject(m_path);
+    }
 }
 
 bool Request::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
 {
-    Q_UNUSED(connection);
-
     /* Check to make sure we're getting properties on our interface */
     if (message.type() != QDBusMessage::MessageType::MethodCallMessage) {
         return false;
     }
 
-    qCDebug(XdgRequestKdeRequest) << message.interface();
-    qCDebug(XdgRequestKdeRequest) << message.member();
-    qCDebug(XdgRequestKdeRequest) << message.path();
+    qCDebug(XdgRequestKdeRequest) << message.interface() << message.member() << message.path();
 
     if (message.interface() == QLatin1String("org.freedesktop.impl.portal.Request")) {
         if (message.member() == QLatin1String("Close")) {
-            if (m_portalName == QLatin1String("org.freedesktop.impl.portal.Inhibit")) {
-                QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Solid.PowerManagement"),
-                                                                      QStringLiteral("/org/kde/Solid/PowerManagement/PolicyAgent"),
-                                                                      QStringLiteral("org.kde.Solid.PowerManagement.PolicyAgent"),
-                                                                      QStringLiteral("ReleaseInhibition"));
-
-                message << m_data.toUInt();
-
-                QDBusPendingCall pendingCall = QDBusConnection::sessionBus().asyncCall(message);
-                QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pendingCall);
-                connect(watcher, &QDBusPendingCallWatcher::finished, this, [this] (QDBusPendingCallWatcher *watcher) {
-                    QDBusPendingReply<> reply = *watcher;
-                    if (reply.isError()) {
-                        qCDebug(XdgRequestKdeRequest) << "Uninhibit error: " << reply.error().message();
-                    } else {
-                        Q_EMIT closeRequested();
-                    }
-                });
-            }
+            Q_EMIT closeRequested();
+            return connection.send(message.createReply());
         }
     }
 
@@ -22,6 +22,7 @@
 #define XDG_DESKTOP_PORTAL_KDE_REQUEST_H
 
 #include <QObject>
+#include <QDBusObjectPath>
 #include <QDBusVirtualObject>
 
 class Request : public QDBusVirtualObject
@@ -29,8 +30,19 @@ class Request : public QDBusVirtualObject
     Q_OBJECT
 public:
     explicit Request(QObject *parent = nullptr, const QString &portalName = QString(), const QVariant &data = QVariant());
+    // Registers itself on the given request handle for as long as it lives
+    explicit Request(const QDBusObjectPath &handle, QObject *parent = nullptr, const QString &portalName = QString(), const QVariant &data = QVariant());
     ~Request() override;
 
+    // Rejects the dialog when the request gets closed, the request is owned by the dialog
+    template<class T>
+    static Request *makeClosableDialogRequest(const QDBusObjectPath &handle, T *dialog)
+    {
+        Request *request = new Request(handle, dialog);
+        connect(request, &Request::closeRequested, dialog, &T::reject);
+        return request;
+    }
+
     bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
     QString introspect(const QString &path) const override;
 
@@ -40,6 +52,7 @@ Q_SIGNALS:
 private:
     const QVariant m_data;
     const QString m_portalName;
+    QString m_path;
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_REQUEST_H
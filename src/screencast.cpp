@@ -19,15 +19,87 @@
  */
 
 #include "screencast.h"
+#include "request.h"
+#include "screencastrestore.h"
 #include "screenchooserdialog.h"
 #include "session.h"
 #include "waylandintegration.h"
 #include "utils.h"
 
+#include <QDBusArgument>
 #include <QLoggingCategory>
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+#include <KWayland/Client/plasmawindowmanagement.h>
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeScreenCast, "xdp-kde-screencast")
 
+static ScreenCastSelection selectionForSources(const QList<quint32> &outputNames, const QList<QByteArray> &windowUuids)
+{
+    ScreenCastSelection selection;
+
+    const WaylandIntegration::WaylandOutputs outputs = WaylandIntegration::screens();
+    for (quint32 outputName : outputNames) {
+        const auto it = outputs->constFind(outputName);
+        if (it != outputs->constEnd()) {
+            selection.outputs.append({it->manufacturer(), it->model(), it->globalPosition()});
+        }
+    }
+
+    if (KWayland::Client::PlasmaWindowManagement *windowManagement = WaylandIntegration::plasmaWindowManagement()) {
+        const auto windows = windowManagement->windows();
+        for (KWayland::Client::PlasmaWindow *window : windows) {
+            if (windowUuids.contains(window->uuid())) {
+                selection.windows.append(window->appId());
+            }
+        }
+    }
+
+    return selection;
+}
+
+// Maps a stored selection back onto what is currently there, fails unless every source was found
+static bool resolveSelection(const ScreenCastSelection &selection, QList<quint32> &outputNames, QList<QByteArray> &windowUuids)
+{
+    const WaylandIntegration::WaylandOutputs outputs = WaylandIntegration::screens();
+    for (const ScreenCastSelection::Output &storedOutput : selection.outputs) {
+        std::optional<quint32> match;
+        for (auto it = outputs->constBegin(), itEnd = outputs->constEnd(); it != itEnd; ++it) {
+            if (outputNames.contains(it.key()) || it->manufacturer() != storedOutput.manufacturer || it->model() != storedOutput.model) {
+                continue;
+            }
+            // Identical monitors are told apart by their position, but a single one may have moved
+            if (!match || it->globalPosition() == storedOutput.position) {
+                match = it.key();
+            }
+        }
+
+        if (!match) {
+            qCDebug(XdgDesktopPortalKdeScreenCast) << "Could not find output" << storedOutput.manufacturer << storedOutput.model;
+            return false;
+        }
+        outputNames.append(*match);
+    }
+
+    KWayland::Client::PlasmaWindowManagement *windowManagement = WaylandIntegration::plasmaWindowManagement();
+    const auto windows = windowManagement ? windowManagement->windows() : QList<KWayland::Client::PlasmaWindow *>();
+    for (const QString &appId : selection.windows) {
+        const auto it = std::find_if(windows.constBegin(), windows.constEnd(), [&appId, &windowUuids] (KWayland::Client::PlasmaWindow *window) {
+            return window->appId() == appId && !windowUuids.contains(window->uuid());
+        });
+
+        if (it == windows.constEnd()) {
+            qCDebug(XdgDesktopPortalKdeScreenCast) << "Could not find a window of" << appId;
+            return false;
+        }
+        windowUuids.append((*it)->uuid());
+    }
+
+    return true;
+}
+
 ScreenCastPortal::ScreenCastPortal(QObject *parent)
     : QDBusAbstractAdaptor(parent)
 {
@@ -37,6 +109,19 @@ ScreenCastPortal::~ScreenCastPortal()
 {
 }
 
+uint ScreenCastPortal::AvailableSourceTypes() const
+{
+    uint types = Monitor;
+    // Windows can only be offered when we get to list them
+    if (WaylandIntegration::plasmaWindowManagement()) {
+        types |= Window;
+    }
+    if (WaylandIntegration::isVirtualOutputStreamingAvailable()) {
+        types |= Virtual;
+    }
+    return types;
+}
+
 uint ScreenCastPortal::CreateSession(const QDBusObjectPath &handle,
                                      const QDBusObjectPath &session_handle,
                                      const QString &app_id,
@@ -62,10 +147,6 @@ uint ScreenCastPortal::CreateSession(const QDBusObjectPath &handle,
         return 2;
     }
 
-    connect(session, &Session::closed, [] () {
-        WaylandIntegration::stopAllStreaming();
-    });
-
     return 0;
 }
 
@@ -92,6 +173,37 @@ uint ScreenCastPortal::SelectSources(const QDBusObjectPath &handle,
 
     session->setMultipleSources(options.value(QStringLiteral("multiple")).toBool());
 
+    if (options.contains(QStringLiteral("types"))) {
+        session->setSourceTypes(SourceTypes(options.value(QStringLiteral("types")).toUInt()));
+    }
+
+    // Not part of the portal specification: lets headless clients pick the
+    // resolution of the virtual output that will be created for them
+    if (options.contains(QStringLiteral("virtual_size"))) {
+        session->setVirtualOutputSize(qdbus_cast<QSize>(options.value(QStringLiteral("virtual_size"))));
+    }
+    if (options.contains(QStringLiteral("virtual_scale"))) {
+        session->setVirtualOutputScale(options.value(QStringLiteral("virtual_scale")).toDouble());
+    }
+
+    if (options.contains(QStringLiteral("cursor_mode"))) {
+        const uint cursorMode = options.value(QStringLiteral("cursor_mode")).toUInt();
+        if (!isCursorModeSupported(cursorMode)) {
+            qCWarning(XdgDesktopPortalKdeScreenCast) << "Unsupported cursor mode requested" << cursorMode;
+            return 2;
+        }
+        session->setCursorMode(static_cast<Screencasting::CursorMode>(cursorMode));
+    }
+
+    if (options.contains(QStringLiteral("persist_mode"))) {
+        const uint persistMode = options.value(QStringLiteral("persist_mode")).toUInt();
+        session->setPersistMode(static_cast<ScreenCastRestore::PersistMode>(qMin<uint>(persistMode, ScreenCastRestore::PersistUntilRevoked)));
+    }
+
+    if (options.contains(QStringLiteral("restore_data"))) {
+        session->setRestoreToken(ScreenCastRestore::tokenFromRestoreData(options.value(QStringLiteral("restore_data"))));
+    }
+
     // Might be also a RemoteDesktopSession
     if (session->type() == Session::RemoteDesktop) {
         RemoteDesktopSession *remoteDesktopSession = qobject_cast<RemoteDesktopSession*>(session);
@@ -126,45 +238,82 @@ uint ScreenCastPortal::Start(const QDBusObjectPath &handle,
         return 2;
     }
 
-    if (WaylandIntegration::screens().isEmpty()) {
+    // A virtual output is created on demand, there is nothing for the user to choose from
+    if (session->sourceTypes() == Virtual) {
+        const WaylandIntegration::Streams streams = WaylandIntegration::startStreamingVirtualOutput(session->virtualOutputName(), session->virtualOutputSize(), session->virtualOutputScale(), session->cursorMode());
+
+        if (streams.isEmpty()) {
+            qCWarning(XdgDesktopPortalKdeScreenCast) << "Failed to create a virtual output";
+            return 2;
+        }
+
+        session->addStreams(streams);
+        results.insert(QStringLiteral("streams"), QVariant::fromValue<WaylandIntegration::Streams>(session->streams()));
+
+        return 0;
+    }
+
+    // Picks up the sources the user chose during an earlier session without asking again
+    if (const auto selection = ScreenCastRestore::take(app_id, session->restoreToken())) {
+        QList<quint32> outputNames;
+        QList<QByteArray> windowUuids;
+        if (resolveSelection(*selection, outputNames, windowUuids)) {
+            const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming(outputNames, windowUuids, session->cursorMode());
+            if (!streams.isEmpty()) {
+                session->addStreams(streams);
+                results.insert(QStringLiteral("streams"), QVariant::fromValue<WaylandIntegration::Streams>(session->streams()));
+                persistSelection(session, app_id, *selection, results);
+
+                return 0;
+            }
+        }
+
+        qCDebug(XdgDesktopPortalKdeScreenCast) << "Could not restore the previous selection of" << app_id << ", asking the user";
+    }
+
+    if (WaylandIntegration::screens()->isEmpty()) {
         qCWarning(XdgDesktopPortalKdeScreenCast) << "Failed to show dialog as there is no screen to select";
         return 2;
     }
 
     QScopedPointer<ScreenChooserDialog, QScopedPointerDeleteLater> screenDialog(new ScreenChooserDialog(app_id, session->multipleSources()));
     Utils::setParentWindow(screenDialog.data(), parent_window);
+    Request::makeClosableDialogRequest(handle, screenDialog.data());
 
-    if (options.contains(QStringLiteral("types"))) {
-        screenDialog->setSourceTypes(SourceTypes(options.value(QStringLiteral("types")).toUInt()));
+    if (session->sourceTypes() != Any) {
+        screenDialog->setSourceTypes(session->sourceTypes());
     }
 
     connect(session, &Session::closed, screenDialog.data(), &ScreenChooserDialog::reject);
 
     if (screenDialog->exec()) {
-        const auto selectedScreens = screenDialog->selectedScreens();
-        for (quint32 outputid : selectedScreens) {
-            if (!WaylandIntegration::startStreamingOutput(outputid, Screencasting::Hidden)) {
-                return 2;
-            }
-        }
-        const auto selectedWindows = screenDialog->selectedWindows();
-        for (const QByteArray &winid : selectedWindows) {
-            if (!WaylandIntegration::startStreamingWindow(winid)) {
-                return 2;
-            }
-        }
+        const QList<quint32> outputNames = screenDialog->selectedScreens();
+        const QList<QByteArray> windowUuids = screenDialog->selectedWindows();
+        const WaylandIntegration::Streams streams = WaylandIntegration::startStreaming(outputNames, windowUuids, session->cursorMode());
 
-        QVariant streams = WaylandIntegration::streams();
-
-        if (!streams.isValid()) {
+        if (streams.isEmpty()) {
             qCWarning(XdgDesktopPortalKdeScreenCast) << "Pipewire stream is not ready to be streamed";
             return 2;
         }
 
-        results.insert(QStringLiteral("streams"), streams);
+        session->addStreams(streams);
+        results.insert(QStringLiteral("streams"), QVariant::fromValue<WaylandIntegration::Streams>(session->streams()));
+        persistSelection(session, app_id, selectionForSources(outputNames, windowUuids), results);
 
         return 0;
     }
 
     return 1;
 }
+
+void ScreenCastPortal::persistSelection(ScreenCastSession *session, const QString &app_id, const ScreenCastSelection &selection, QVariantMap &results)
+{
+    // Tokens are single use, every successful start hands out a new one
+    const QString token = ScreenCastRestore::store(app_id, session->owner(), selection, session->persistMode());
+    if (token.isEmpty()) {
+        return;
+    }
+
+    results.insert(QStringLiteral("persist_mode"), static_cast<uint>(session->persistMode()));
+    results.insert(QStringLiteral("restore_data"), ScreenCastRestore::restoreDataFromToken(token));
+}
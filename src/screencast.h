@@ -24,19 +24,22 @@
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
 
+class ScreenCastSession;
+struct ScreenCastSelection;
 
 class ScreenCastPortal : public QDBusAbstractAdaptor
 {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.ScreenCast")
     Q_PROPERTY(uint version READ version CONSTANT)
-    Q_PROPERTY(uint AvailableSourceTypes READ AvailableSourceTypes CONSTANT)
+    Q_PROPERTY(uint AvailableSourceTypes READ AvailableSourceTypes)
     Q_PROPERTY(uint AvailableCursorModes READ AvailableCursorModes CONSTANT)
 public:
     enum SourceType {
         Any = 0,
-        Monitor,
-        Window
+        Monitor = 1,
+        Window = 2,
+        Virtual = 4
     };
     Q_ENUM(SourceType);
     Q_DECLARE_FLAGS(SourceTypes, SourceType)
@@ -51,9 +54,14 @@ public:
     explicit ScreenCastPortal(QObject *parent);
     ~ScreenCastPortal();
 
-    uint version() const { return 1; }
-    uint AvailableSourceTypes() const { return Monitor; };
-    uint AvailableCursorModes() const { return Hidden | Embedded; };
+    uint version() const { return 4; }
+    uint AvailableSourceTypes() const;
+    uint AvailableCursorModes() const { return Hidden | Embedded | Metadata; }
+    // Only a single mode may be requested and it has to be one we announced
+    static bool isCursorModeSupported(uint mode)
+    {
+        return qPopulationCount(mode) == 1 && (mode & (Hidden | Embedded | Metadata));
+    }
 
 public Q_SLOTS:
     uint CreateSession(const QDBusObjectPath &handle,
@@ -74,6 +82,9 @@ public Q_SLOTS:
                const QString &parent_window,
                const QVariantMap &options,
                QVariantMap &results);
+
+private:
+    void persistSelection(ScreenCastSession *session, const QString &app_id, const ScreenCastSelection &selection, QVariantMap &results);
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_SCREENCAST_H
@@ -19,10 +19,20 @@ class ScreencastingStreamPrivate : public QtWayland::zkde_screencast_stream_unst
 public:
     ScreencastingStreamPrivate(ScreencastingStream* q) : q(q) {}
     ~ScreencastingStreamPrivate() {
-        close();
+        if (object()) {
+            close();
+        }
         q->deleteLater();
     }
 
+    // Drops the proxy without talking to the compositor, for when the connection is gone
+    void destroyProxy() {
+        if (object()) {
+            wl_proxy_destroy(reinterpret_cast<wl_proxy *>(object()));
+            init(static_cast<::zkde_screencast_stream_unstable_v1 *>(nullptr));
+        }
+    }
+
     void zkde_screencast_stream_unstable_v1_created(uint32_t node) override {
         m_nodeid = node;
         Q_EMIT q->created(node);
@@ -53,11 +63,21 @@ quint32 ScreencastingStream::nodeid() const
     return d->m_nodeid;
 }
 
+void ScreencastingStream::destroy()
+{
+    if (!d->object()) {
+        return;
+    }
+
+    d->destroyProxy();
+    Q_EMIT closed();
+}
+
 class ScreencastingPrivate : public QtWayland::zkde_screencast_unstable_v1
 {
 public:
     ScreencastingPrivate(Registry *registry, int id, int version, Screencasting *q)
-        : QtWayland::zkde_screencast_unstable_v1(*registry, id, version)
+        : QtWayland::zkde_screencast_unstable_v1(*registry, id, qMin(version, zkde_screencast_unstable_v1_interface.version))
         , q(q)
     {
     }
@@ -70,7 +90,17 @@ public:
 
     ~ScreencastingPrivate()
     {
-        destroy();
+        if (object()) {
+            destroy();
+        }
+    }
+
+    void destroyProxy()
+    {
+        if (object()) {
+            wl_proxy_destroy(reinterpret_cast<wl_proxy *>(object()));
+            init(static_cast<::zkde_screencast_unstable_v1 *>(nullptr));
+        }
     }
 
     Screencasting *const q;
@@ -109,6 +139,19 @@ ScreencastingStream* Screencasting::createWindowStream(const QString &uuid, Curs
     return stream;
 }
 
+ScreencastingStream* Screencasting::createVirtualOutputStream(const QString &name, const QSize &size, qreal scale, CursorMode mode)
+{
+    auto stream = new ScreencastingStream(this);
+    stream->setObjectName(name);
+    stream->d->init(d->stream_virtual_output(name, size.width(), size.height(), wl_fixed_from_double(scale), mode));
+    return stream;
+}
+
+bool Screencasting::supportsVirtualOutputs() const
+{
+    return d && zkde_screencast_unstable_v1_get_version(d->object()) >= ZKDE_SCREENCAST_UNSTABLE_V1_STREAM_VIRTUAL_OUTPUT_SINCE_VERSION;
+}
+
 void Screencasting::setup(::zkde_screencast_unstable_v1* screencasting)
 {
     d.reset(new ScreencastingPrivate(screencasting, this));
@@ -116,5 +159,8 @@ void Screencasting::setup(::zkde_screencast_unstable_v1* screencasting)
 
 void Screencasting::destroy()
 {
+    if (d) {
+        d->destroyProxy();
+    }
     d.reset(nullptr);
 }
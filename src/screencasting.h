@@ -9,6 +9,7 @@
 #include <QVector>
 #include <QObject>
 #include <QSharedPointer>
+#include <QSize>
 #include <optional>
 
 struct zkde_screencast_unstable_v1;
@@ -35,6 +36,10 @@ public:
 
     quint32 nodeid() const;
 
+    // Like KWayland's destroy(), releases the stream without a request to the compositor.
+    // Use it once the connection died, emits closed().
+    void destroy();
+
 Q_SIGNALS:
     void created(quint32 nodeid);
     void failed(const QString &error);
@@ -63,8 +68,12 @@ public:
     ScreencastingStream* createOutputStream(KWayland::Client::Output* output, CursorMode mode);
     ScreencastingStream* createWindowStream(KWayland::Client::PlasmaWindow* window, CursorMode mode);
     ScreencastingStream* createWindowStream(const QString &uuid, CursorMode mode);
+    ScreencastingStream* createVirtualOutputStream(const QString &name, const QSize &size, qreal scale, CursorMode mode);
+
+    bool supportsVirtualOutputs() const;
 
     void setup(zkde_screencast_unstable_v1* screencasting);
+    // Releases the global without a request to the compositor, e.g. once the connection died
     void destroy();
 
 Q_SIGNALS:
@@ -0,0 +1,183 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "screencastrestore.h"
+
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QUuid>
+
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeScreenCastRestore, "xdp-kde-screencast-restore")
+
+static const QString s_restoreVendor = QStringLiteral("KDE");
+static const uint s_restoreVersion = 1;
+
+struct TransientSelection {
+    ScreenCastSelection selection;
+    // Unique name of the client, the token dies with it
+    QString owner;
+};
+typedef QHash<QString, TransientSelection> TransientSelections;
+// app id + token -> selection, for PersistWhileRunning
+Q_GLOBAL_STATIC(TransientSelections, transientSelections)
+static QDBusServiceWatcher *transientOwnerWatcher = nullptr;
+
+static void dropTransientSelections(const QString &owner)
+{
+    transientOwnerWatcher->removeWatchedService(owner);
+
+    for (auto it = transientSelections->begin(); it != transientSelections->end();) {
+        if (it->owner == owner) {
+            it = transientSelections->erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static void watchTransientOwner(const QString &owner)
+{
+    if (!transientOwnerWatcher) {
+        transientOwnerWatcher = new QDBusServiceWatcher(QString(), QDBusConnection::sessionBus(), QDBusServiceWatcher::WatchForUnregistration, QCoreApplication::instance());
+        QObject::connect(transientOwnerWatcher, &QDBusServiceWatcher::serviceUnregistered, &dropTransientSelections);
+    }
+    transientOwnerWatcher->addWatchedService(owner);
+}
+
+static QString transientKey(const QString &appId, const QString &token)
+{
+    return appId + QLatin1Char('/') + token;
+}
+
+static KSharedConfigPtr restoreConfig()
+{
+    return KSharedConfig::openConfig(QStringLiteral("xdg-desktop-portal-kde-screencastrc"), KConfig::SimpleConfig);
+}
+
+QString ScreenCastRestore::store(const QString &appId, const QString &owner, const ScreenCastSelection &selection, PersistMode mode)
+{
+    if (mode == DoNotPersist || selection.isEmpty()) {
+        return QString();
+    }
+
+    const QString token = QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    if (mode == PersistWhileRunning) {
+        // Without an owner to watch, we couldn't tell when the application is gone
+        if (owner.isEmpty()) {
+            return QString();
+        }
+        transientSelections->insert(transientKey(appId, token), {selection, owner});
+        watchTransientOwner(owner);
+        return token;
+    }
+
+    // The application gets a new token on every start, the one it had before is used up or lost
+    KConfigGroup appGroup = restoreConfig()->group(appId);
+    const QStringList oldTokens = appGroup.groupList();
+    for (const QString &oldToken : oldTokens) {
+        appGroup.deleteGroup(oldToken);
+    }
+
+    KConfigGroup tokenGroup = appGroup.group(token);
+    for (int i = 0; i < selection.outputs.count(); ++i) {
+        const ScreenCastSelection::Output &output = selection.outputs.at(i);
+        KConfigGroup outputGroup = tokenGroup.group(QStringLiteral("Output %1").arg(i));
+        outputGroup.writeEntry("Manufacturer", output.manufacturer);
+        outputGroup.writeEntry("Model", output.model);
+        outputGroup.writeEntry("Position", output.position);
+    }
+    tokenGroup.writeEntry("Windows", selection.windows);
+    tokenGroup.sync();
+
+    return token;
+}
+
+std::optional<ScreenCastSelection> ScreenCastRestore::take(const QString &appId, const QString &token)
+{
+    if (token.isEmpty()) {
+        return std::nullopt;
+    }
+
+    const QString key = transientKey(appId, token);
+    if (transientSelections->contains(key)) {
+        return transientSelections->take(key).selection;
+    }
+
+    KConfigGroup appGroup = restoreConfig()->group(appId);
+    if (!appGroup.hasGroup(token)) {
+        qCDebug(XdgDesktopPortalKdeScreenCastRestore) << "Unknown restore token" << token << "for" << appId;
+        return std::nullopt;
+    }
+
+    KConfigGroup tokenGroup = appGroup.group(token);
+    ScreenCastSelection selection;
+    const QStringList groups = tokenGroup.groupList();
+    for (const QString &groupName : groups) {
+        const KConfigGroup outputGroup = tokenGroup.group(groupName);
+        ScreenCastSelection::Output output;
+        output.manufacturer = outputGroup.readEntry("Manufacturer", QString());
+        output.model = outputGroup.readEntry("Model", QString());
+        output.position = outputGroup.readEntry("Position", QPoint());
+        selection.outputs.append(output);
+    }
+    selection.windows = tokenGroup.readEntry("Windows", QStringList());
+
+    tokenGroup.deleteGroup();
+    appGroup.sync();
+
+    return selection;
+}
+
+QString ScreenCastRestore::tokenFromRestoreData(const QVariant &restoreData)
+{
+    if (!restoreData.canConvert<QDBusArgument>()) {
+        return QString();
+    }
+
+    QString vendor;
+    uint version = 0;
+    QDBusVariant data;
+
+    const QDBusArgument arg = restoreData.value<QDBusArgument>();
+    arg.beginStructure();
+    arg >> vendor >> version >> data;
+    arg.endStructure();
+
+    if (vendor != s_restoreVendor || version != s_restoreVersion) {
+        qCDebug(XdgDesktopPortalKdeScreenCastRestore) << "Ignoring restore data from" << vendor << version;
+        return QString();
+    }
+
+    return data.variant().toString();
+}
+
+QVariant ScreenCastRestore::restoreDataFromToken(const QString &token)
+{
+    QDBusArgument arg;
+    arg.beginStructure();
+    arg << s_restoreVendor << s_restoreVersion << QDBusVariant(token);
+    arg.endStructure();
+
+    return QVariant::fromValue(arg);
+}
@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_SCREENCAST_RESTORE_H
+#define XDG_DESKTOP_PORTAL_KDE_SCREENCAST_RESTORE_H
+
+#include <QPoint>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <optional>
+
+class QVariant;
+
+// Sources picked by the user, stored in a way that can be matched again after the
+// compositor restarted and handed out new Wayland names and window uuids
+struct ScreenCastSelection
+{
+    struct Output {
+        QString manufacturer;
+        QString model;
+        // Only used to tell identical monitors apart
+        QPoint position;
+    };
+
+    QVector<Output> outputs;
+    // App ids of the selected windows
+    QStringList windows;
+
+    bool isEmpty() const { return outputs.isEmpty() && windows.isEmpty(); }
+};
+
+class ScreenCastRestore
+{
+public:
+    enum PersistMode {
+        DoNotPersist = 0,
+        PersistWhileRunning = 1,
+        PersistUntilRevoked = 2
+    };
+
+    // Stores the selection and returns the token the application has to hand back to restore it.
+    // PersistWhileRunning tokens are dropped once owner leaves the bus, an application only
+    // keeps its latest PersistUntilRevoked token.
+    static QString store(const QString &appId, const QString &owner, const ScreenCastSelection &selection, PersistMode mode);
+
+    // Restore tokens are single use, a successfully looked up token is removed
+    static std::optional<ScreenCastSelection> take(const QString &appId, const QString &token);
+
+    // Our restore_data is ("KDE", 1, <token>), returns an empty string for anything else
+    static QString tokenFromRestoreData(const QVariant &restoreData);
+    static QVariant restoreDataFromToken(const QString &token);
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_SCREENCAST_RESTORE_H
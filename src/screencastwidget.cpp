@@ -26,22 +26,15 @@
 ScreenCastWidget::ScreenCastWidget(QWidget *parent)
     : QListWidget(parent)
 {
-    QMapIterator<quint32, WaylandIntegration::WaylandOutput> it(WaylandIntegration::screens());
-    while (it.hasNext()) {
-        it.next();
-        QListWidgetItem *widgetItem = new QListWidgetItem(this);
-        widgetItem->setData(Qt::UserRole, it.key());
-        if (it.value().outputType() == WaylandIntegration::WaylandOutput::Laptop) {
-            widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("computer-laptop")));
-            widgetItem->setText(i18n("Laptop screen\nModel: %1", it.value().model()));
-        } else if (it.value().outputType() == WaylandIntegration::WaylandOutput::Monitor) {
-            widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("video-display")));
-            widgetItem->setText(i18n("Manufacturer: %1\nModel: %2", it.value().manufacturer(), it.value().model()));
-        } else {
-            widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("video-television")));
-            widgetItem->setText(i18n("Manufacturer: %1\nModel: %2", it.value().manufacturer(), it.value().model()));
-        }
+    const auto screens = WaylandIntegration::screens();
+    for (auto it = screens->constBegin(), itEnd = screens->constEnd(); it != itEnd; ++it) {
+        updateScreen(it.key());
     }
+
+    auto waylandIntegration = WaylandIntegration::waylandIntegration();
+    connect(waylandIntegration, &WaylandIntegration::WaylandIntegration::outputAdded, this, &ScreenCastWidget::updateScreen);
+    connect(waylandIntegration, &WaylandIntegration::WaylandIntegration::outputChanged, this, &ScreenCastWidget::updateScreen);
+    connect(waylandIntegration, &WaylandIntegration::WaylandIntegration::outputRemoved, this, &ScreenCastWidget::removeScreen);
 }
 
 ScreenCastWidget::~ScreenCastWidget()
@@ -59,3 +52,35 @@ QList<quint32> ScreenCastWidget::selectedScreens() const
 
     return selectedScreens;
 }
+
+void ScreenCastWidget::updateScreen(quint32 name)
+{
+    const auto screens = WaylandIntegration::screens();
+    const auto it = screens->constFind(name);
+    if (it == screens->constEnd()) {
+        return;
+    }
+
+    QListWidgetItem *widgetItem = m_items.value(name);
+    if (!widgetItem) {
+        widgetItem = new QListWidgetItem(this);
+        widgetItem->setData(Qt::UserRole, name);
+        m_items.insert(name, widgetItem);
+    }
+
+    if (it->outputType() == WaylandIntegration::WaylandOutput::Laptop) {
+        widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("computer-laptop")));
+        widgetItem->setText(i18n("Laptop screen\nModel: %1", it->model()));
+    } else if (it->outputType() == WaylandIntegration::WaylandOutput::Monitor) {
+        widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("video-display")));
+        widgetItem->setText(i18n("Manufacturer: %1\nModel: %2", it->manufacturer(), it->model()));
+    } else {
+        widgetItem->setIcon(QIcon::fromTheme(QStringLiteral("video-television")));
+        widgetItem->setText(i18n("Manufacturer: %1\nModel: %2", it->manufacturer(), it->model()));
+    }
+}
+
+void ScreenCastWidget::removeScreen(quint32 name)
+{
+    delete m_items.take(name);
+}
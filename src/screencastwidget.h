@@ -21,6 +21,7 @@
 #ifndef XDG_DESKTOP_PORTAL_KDE_SCREENCAST_WIDGET_H
 #define XDG_DESKTOP_PORTAL_KDE_SCREENCAST_WIDGET_H
 
+#include <QHash>
 #include <QListWidget>
 
 class ScreenCastWidget : public QListWidget
@@ -31,6 +32,12 @@ public:
     ~ScreenCastWidget();
 
     QList<quint32> selectedScreens() const;
+
+private:
+    void updateScreen(quint32 name);
+    void removeScreen(quint32 name);
+
+    QHash<quint32, QListWidgetItem *> m_items;
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_SCREENCAST_WIDGET_H
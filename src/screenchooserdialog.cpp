@@ -20,22 +20,201 @@
 
 #include "screenchooserdialog.h"
 #include "ui_screenchooserdialog.h"
+#include "utils.h"
 #include "waylandintegration.h"
 
 #include <KLocalizedString>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusUnixFileDescriptor>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QLoggingCategory>
+#include <QPixmap>
 #include <QPushButton>
-#include <QStandardPaths>
-#include <QSettings>
+#include <QQueue>
+#include <QSet>
 #include <QSortFilterProxyModel>
+#include <QtConcurrentRun>
+#include <qplatformdefs.h>
 #include <KWayland/Client/plasmawindowmodel.h>
 #include <KWayland/Client/plasmawindowmanagement.h>
 
-class FilteredWindowModel : public QSortFilterProxyModel
+#include <fcntl.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(XdgDesktopPortalKdeScreenChooserDialog, "xdp-kde-screenchooser-dialog")
+
+static const QSize s_thumbnailSize(160, 90);
+
+static QImage readThumbnail(int pipeFd, const QVariantMap &metadata)
 {
+    QByteArray content;
+    char buf[4096];
+    while (true) {
+        const qint64 n = QT_READ(pipeFd, buf, sizeof buf);
+        if (n > 0) {
+            content.append(buf, n);
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    close(pipeFd);
+
+    const int width = metadata.value(QStringLiteral("width")).toInt();
+    const int height = metadata.value(QStringLiteral("height")).toInt();
+    const int stride = metadata.value(QStringLiteral("stride")).toInt();
+    const auto format = static_cast<QImage::Format>(metadata.value(QStringLiteral("format")).toUInt());
+    if (width <= 0 || height <= 0 || content.size() < qint64(stride) * height) {
+        return QImage();
+    }
+
+    const QImage image(reinterpret_cast<const uchar *>(content.constData()), width, height, stride, format);
+    // Scaling creates a deep copy, so the result outlives content
+    return image.scaled(s_thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+// Captures windows through KWin, one at a time and only once per window, the view only
+// asks for the decoration of rows it is about to paint
+class WindowThumbnailCache : public QObject
+{
+    Q_OBJECT
 public:
-    FilteredWindowModel(QObject* parent) : QSortFilterProxyModel(parent)
+    WindowThumbnailCache(QObject *parent) : QObject(parent)
     {}
 
+    ~WindowThumbnailCache() override
+    {
+        // Nobody reads the capture which is still pending anymore, let KWin's write fail
+        // instead of blocking on a full pipe
+        if (m_pendingFd >= 0) {
+            ::close(m_pendingFd);
+        }
+    }
+
+    QPixmap thumbnail(const QByteArray &uuid)
+    {
+        const auto it = m_thumbnails.constFind(uuid);
+        if (it != m_thumbnails.constEnd()) {
+            return *it;
+        }
+
+        if (m_available && !m_pending.contains(uuid)) {
+            m_pending.insert(uuid);
+            m_queue.enqueue(uuid);
+            captureNext();
+        }
+        return QPixmap();
+    }
+
+Q_SIGNALS:
+    void thumbnailReady(const QByteArray &uuid);
+
+private:
+    void captureNext()
+    {
+        if (m_capturing || m_queue.isEmpty()) {
+            return;
+        }
+
+        m_capturing = true;
+        capture(m_queue.dequeue());
+    }
+
+    void capture(const QByteArray &uuid)
+    {
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+            finish(uuid, QImage());
+            return;
+        }
+
+        QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.KWin"),
+                                                              QStringLiteral("/org/kde/KWin/ScreenShot2"),
+                                                              QStringLiteral("org.kde.KWin.ScreenShot2"),
+                                                              QStringLiteral("CaptureWindow"));
+        message << QString::fromUtf8(uuid)
+                << QVariantMap{{QStringLiteral("include-decoration"), true}}
+                << QVariant::fromValue(QDBusUnixFileDescriptor(pipeFds[1]));
+
+        QDBusPendingCallWatcher *callWatcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+        ::close(pipeFds[1]);
+
+        const int readFd = pipeFds[0];
+        m_pendingFd = readFd;
+        connect(callWatcher, &QDBusPendingCallWatcher::finished, this, [this, uuid, readFd] (QDBusPendingCallWatcher *callWatcher) {
+            callWatcher->deleteLater();
+            // From here on the fd is closed below or by readThumbnail
+            m_pendingFd = -1;
+
+            const QDBusPendingReply<QVariantMap> reply = *callWatcher;
+            if (reply.isError()) {
+                ::close(readFd);
+                qCDebug(XdgDesktopPortalKdeScreenChooserDialog) << "Failed to capture window" << uuid << reply.error().message();
+                if (reply.error().type() == QDBusError::ServiceUnknown || reply.error().type() == QDBusError::UnknownObject
+                    || reply.error().type() == QDBusError::UnknownMethod || reply.error().type() == QDBusError::AccessDenied) {
+                    // No point in asking for every other window
+                    m_available = false;
+                    m_queue.clear();
+                }
+                finish(uuid, QImage());
+                return;
+            }
+
+            QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+            connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, uuid] {
+                watcher->deleteLater();
+                finish(uuid, watcher->result());
+            });
+            watcher->setFuture(QtConcurrent::run(readThumbnail, readFd, reply.value()));
+        });
+    }
+
+    void finish(const QByteArray &uuid, const QImage &image)
+    {
+        m_pending.remove(uuid);
+        // A null pixmap is cached too, so that a failing window is not captured over and over
+        m_thumbnails.insert(uuid, QPixmap::fromImage(image));
+        if (!image.isNull()) {
+            Q_EMIT thumbnailReady(uuid);
+        }
+
+        m_capturing = false;
+        captureNext();
+    }
+
+    bool m_available = true;
+    bool m_capturing = false;
+    // Read end of the pipe of the CaptureWindow call in flight
+    int m_pendingFd = -1;
+    QHash<QByteArray, QPixmap> m_thumbnails;
+    // Requested windows, either queued or being captured
+    QSet<QByteArray> m_pending;
+    QQueue<QByteArray> m_queue;
+};
+
+class FilteredWindowModel : public QSortFilterProxyModel
+{
+public:
+    FilteredWindowModel(QObject* parent)
+        : QSortFilterProxyModel(parent)
+        , m_thumbnails(new WindowThumbnailCache(this))
+    {
+        connect(m_thumbnails, &WindowThumbnailCache::thumbnailReady, this, &FilteredWindowModel::thumbnailReady);
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override {
+        if (role == Qt::DecorationRole) {
+            const QPixmap thumbnail = m_thumbnails->thumbnail(index.data(KWayland::Client::PlasmaWindowModel::Uuid).toByteArray());
+            if (!thumbnail.isNull()) {
+                return thumbnail;
+            }
+        }
+        return QSortFilterProxyModel::data(index, role);
+    }
+
     bool filterAcceptsRow(int source_row, const QModelIndex & source_parent) const override {
         if (source_parent.isValid())
             return false;
@@ -47,6 +226,20 @@ public:
             && !idx.data(PlasmaWindowModel::SkipSwitcher).toBool()
             && idx.data(PlasmaWindowModel::Pid) != QCoreApplication::applicationPid();
     }
+
+private:
+    void thumbnailReady(const QByteArray &uuid)
+    {
+        for (int row = 0, count = rowCount(); row < count; ++row) {
+            const QModelIndex idx = index(row, 0);
+            if (idx.data(KWayland::Client::PlasmaWindowModel::Uuid).toByteArray() == uuid) {
+                Q_EMIT dataChanged(idx, idx, {Qt::DecorationRole});
+                return;
+            }
+        }
+    }
+
+    WindowThumbnailCache *const m_thumbnails;
 };
 
 ScreenChooserDialog::ScreenChooserDialog(const QString &appName, bool multiple, QDialog *parent, Qt::WindowFlags flags)
@@ -64,6 +257,9 @@ ScreenChooserDialog::ScreenChooserDialog(const QString &appName, bool multiple,
     auto proxy = new FilteredWindowModel(this);
     proxy->setSourceModel(model);
     m_dialog->windowsView->setModel(proxy);
+    m_dialog->windowsView->setIconSize(s_thumbnailSize);
+    // Otherwise the layout asks every row for its decoration and all windows get captured up front
+    m_dialog->windowsView->setUniformItemSizes(true);
 
     connect(m_dialog->buttonBox, &QDialogButtonBox::accepted, this, &ScreenChooserDialog::accept);
     connect(m_dialog->buttonBox, &QDialogButtonBox::rejected, this, &ScreenChooserDialog::reject);
@@ -76,22 +272,7 @@ ScreenChooserDialog::ScreenChooserDialog(const QString &appName, bool multiple,
     okButton->setText(i18n("Share"));
     okButton->setEnabled(false);
 
-    QString applicationName;
-    const QString desktopFile = appName + QLatin1String(".desktop");
-    const QStringList desktopFileLocations = QStandardPaths::locateAll(QStandardPaths::ApplicationsLocation, desktopFile, QStandardPaths::LocateFile);
-    for (const QString &location : desktopFileLocations) {
-        QSettings settings(location, QSettings::IniFormat);
-        settings.beginGroup(QStringLiteral("Desktop Entry"));
-        if (settings.contains(QStringLiteral("X-GNOME-FullName"))) {
-            applicationName = settings.value(QStringLiteral("X-GNOME-FullName")).toString();
-        } else {
-            applicationName = settings.value(QStringLiteral("Name")).toString();
-        }
-
-        if (!applicationName.isEmpty()) {
-            break;
-        }
-    }
+    const QString applicationName = Utils::applicationName(appName);
 
     if (applicationName.isEmpty()) {
         setWindowTitle(i18n("Select screen to share with the requesting application"));
@@ -142,3 +323,5 @@ QList<QByteArray> ScreenChooserDialog::selectedWindows() const
     }
     return ret;
 }
+
+#include "screenchooserdialog.moc"
@@ -19,6 +19,7 @@
  */
 
 #include "screenshot.h"
+#include "request.h"
 #include "screenshotdialog.h"
 #include "utils.h"
 
@@ -99,6 +100,7 @@ uint ScreenshotPortal::Screenshot(const QDBusObjectPath &handle,
 
     QPointer<ScreenshotDialog> screenshotDialog = new ScreenshotDialog;
     Utils::setParentWindow(screenshotDialog, parent_window);
+    Request::makeClosableDialogRequest(handle, screenshotDialog.data());
 
     const bool modal = options.value(QStringLiteral("modal"), false).toBool();
     screenshotDialog->setModal(modal);
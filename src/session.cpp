@@ -20,21 +20,79 @@
 
 #include "session.h"
 #include "desktopportal.h"
+#include "inputchannel.h"
+#include "inputlatency.h"
+#include "waylandintegration.h"
 
+#include <QCoreApplication>
 #include <QDBusConnection>
+#include <QDBusConnectionInterface>
 #include <QDBusMessage>
 #include <QDBusPendingCall>
 #include <QDBusPendingCallWatcher>
+#include <QDBusServiceWatcher>
+#include <QHash>
 #include <QLoggingCategory>
 
+#include <algorithm>
+
 Q_LOGGING_CATEGORY(XdgSessionKdeSession, "xdp-kde-session")
 
-static QMap<QString, Session*> sessionList;
+static QHash<QString, Session*> sessionList;
+// Input notifications come in bursts for the same session, remember the last hit.
+// Every call carries the handle as a freshly demarshalled string, so there is no pointer or id
+// to intern it by: it has to be hashed or compared once per call either way. Comparing it to the
+// last handle is a single memcmp and spares the hash and bucket walk.
+static QString lastSessionHandle;
+static Session *lastSession = nullptr;
+// Watches the clients owning our sessions, so sessions of crashed clients don't linger
+static QDBusServiceWatcher *ownerWatcher = nullptr;
+static int reapedSessions = 0;
+
+// Session handles look like /org/freedesktop/portal/desktop/session/1_42/token,
+// where 1_42 is the unique name :1.42 of the client that created the session
+static QString ownerFromSessionPath(const QString &path)
+{
+    static const QLatin1String prefix("/org/freedesktop/portal/desktop/session/");
+    if (!path.startsWith(prefix)) {
+        return QString();
+    }
+
+    const QString sender = path.mid(prefix.size()).section(QLatin1Char('/'), 0, 0);
+    if (sender.isEmpty()) {
+        return QString();
+    }
+
+    return QLatin1Char(':') + QString(sender).replace(QLatin1Char('_'), QLatin1Char('.'));
+}
+
+static void reapSessions(const QString &owner)
+{
+    QList<Session*> sessions;
+    for (Session *session : qAsConst(sessionList)) {
+        if (session->owner() == owner) {
+            sessions << session;
+        }
+    }
+
+    if (sessions.isEmpty()) {
+        return;
+    }
+
+    reapedSessions += sessions.count();
+    qCInfo(XdgSessionKdeSession) << "Client" << owner << "disappeared, reaping" << sessions.count() << "session(s)," << reapedSessions << "in total";
+
+    for (Session *session : qAsConst(sessions)) {
+        session->close();
+        Q_EMIT session->closed();
+    }
+}
 
 Session::Session(QObject *parent, const QString &appId, const QString &path)
     : QDBusVirtualObject(parent)
     , m_appId(appId)
     , m_path(path)
+    , m_owner(ownerFromSessionPath(path))
 {
 }
 
@@ -44,44 +102,34 @@ Session::~Session()
 
 bool Session::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
 {
-    Q_UNUSED(connection);
-
-    if (message.path() != m_path) {
+    if (message.type() != QDBusMessage::MessageType::MethodCallMessage || message.path() != m_path) {
         return false;
     }
 
-    /* Check to make sure we're getting properties on our interface */
-    if (message.type() != QDBusMessage::MessageType::MethodCallMessage) {
-        return false;
+    // Dispatch on the member first, it is short and rules out everything but two calls
+    const QString member = message.member();
+
+    if (member == QLatin1String("Close")) {
+        if (message.interface() != QLatin1String("org.freedesktop.impl.portal.Session")) {
+            return false;
+        }
+        Q_EMIT closed();
+        return connection.send(message.createReply());
     }
 
-    qCDebug(XdgSessionKdeSession) << message.interface();
-    qCDebug(XdgSessionKdeSession) << message.member();
-    qCDebug(XdgSessionKdeSession) << message.path();
+    if (member == QLatin1String("Get")) {
+        if (message.interface() != QLatin1String("org.freedesktop.DBus.Properties")) {
+            return false;
+        }
 
-    if (message.interface() == QLatin1String("org.freedesktop.impl.portal.Session")) {
-        if (message.member() == QLatin1String("Close")) {
-            Q_EMIT closed();
+        const QList<QVariant> arguments = message.arguments();
+        if (arguments.count() == 2 &&
+            arguments.at(0).toString() == QLatin1String("org.freedesktop.impl.portal.Session") &&
+            arguments.at(1).toString() == QLatin1String("version")) {
             QDBusMessage reply = message.createReply();
+            reply.setArguments({1});
             return connection.send(reply);
         }
-    } else if (message.interface() == QLatin1String("org.freedesktop.DBus.Properties")) {
-        if (message.member() == QLatin1String("Get")) {
-            if (message.arguments().count() == 2) {
-                const QString interface = message.arguments().at(0).toString();
-                const QString property = message.arguments().at(1).toString();
-
-                if (interface == QLatin1String("org.freedesktop.impl.portal.Session") &&
-                    property == QLatin1String("version")) {
-                    QList<QVariant> arguments;
-                    arguments << 1;
-
-                    QDBusMessage reply = message.createReply();
-                    reply.setArguments(arguments);
-                    return connection.send(reply);
-                }
-            }
-        }
     }
 
     return false;
@@ -100,6 +148,17 @@ QString Session::introspect(const QString &path) const
             "</signal>"
             "<property name=\"version\" type=\"u\" access=\"read\"/>"
             "</interface>");
+
+        // xdg-desktop-portal doesn't forward this interface, clients which
+        // want stream updates have to subscribe on our service directly
+        if (type() == ScreenCast || type() == RemoteDesktop) {
+            nodes += QStringLiteral(
+                "<interface name=\"org.kde.XdgDesktopPortalKde.ScreenCastSession\">"
+                "<signal name=\"StreamsChanged\">"
+                "    <arg name=\"streams\" type=\"a(ua{sv})\"/>"
+                "</signal>"
+                "</interface>");
+        }
     }
 
     qCDebug(XdgSessionKdeSession) << nodes;
@@ -120,17 +179,44 @@ Session * Session::createSession(QObject *parent, SessionType type, const QStrin
     Session *session = nullptr;
     if (type == ScreenCast) {
         session = new ScreenCastSession(parent, appId, path);
-    } else {
+    } else if (type == RemoteDesktop) {
         session = new RemoteDesktopSession(parent, appId, path);
+    } else {
+        session = new InhibitMonitorSession(parent, appId, path);
     }
 
     if (sessionBus.registerVirtualObject(path, session, QDBusConnection::VirtualObjectRegisterOption::SubPath)) {
         connect(session, &Session::closed, [session, path] () {
             sessionList.remove(path);
+            if (lastSession == session) {
+                lastSession = nullptr;
+                lastSessionHandle.clear();
+            }
             QDBusConnection::sessionBus().unregisterObject(path);
             session->deleteLater();
+
+            const QString owner = session->owner();
+            if (!owner.isEmpty() && std::none_of(sessionList.cbegin(), sessionList.cend(), [owner] (Session *other) { return other->owner() == owner; })) {
+                ownerWatcher->removeWatchedService(owner);
+            }
         });
         sessionList.insert(path, session);
+
+        if (!session->owner().isEmpty()) {
+            if (!ownerWatcher) {
+                ownerWatcher = new QDBusServiceWatcher(QString(), sessionBus, QDBusServiceWatcher::WatchForUnregistration, QCoreApplication::instance());
+                connect(ownerWatcher, &QDBusServiceWatcher::serviceUnregistered, &reapSessions);
+            }
+            ownerWatcher->addWatchedService(session->owner());
+
+            // The client may have gone away before we started watching it
+            if (!sessionBus.interface()->isServiceRegistered(session->owner())) {
+                QMetaObject::invokeMethod(ownerWatcher, [owner = session->owner()] {
+                    reapSessions(owner);
+                }, Qt::QueuedConnection);
+            }
+        }
+
         return session;
     } else {
         qCDebug(XdgSessionKdeSession) << sessionBus.lastError().message();
@@ -142,16 +228,58 @@ Session * Session::createSession(QObject *parent, SessionType type, const QStrin
 
 Session * Session::getSession(const QString &sessionHandle)
 {
-    return sessionList.value(sessionHandle);
+    if (lastSession && lastSessionHandle == sessionHandle) {
+        return lastSession;
+    }
+
+    Session *session = sessionList.value(sessionHandle);
+    if (session) {
+        lastSession = session;
+        lastSessionHandle = sessionHandle;
+    }
+    return session;
+}
+
+int Session::reapedSessionCount()
+{
+    return reapedSessions;
+}
+
+RemoteDesktopSession * Session::getRemoteDesktopSession(const QString &sessionHandle)
+{
+    Session *session = getSession(sessionHandle);
+    if (!session || session->type() != SessionType::RemoteDesktop) {
+        return nullptr;
+    }
+    return static_cast<RemoteDesktopSession*>(session);
+}
+
+InhibitMonitorSession::InhibitMonitorSession(QObject *parent, const QString &appId, const QString &path)
+    : Session(parent, appId, path)
+{
+}
+
+InhibitMonitorSession::~InhibitMonitorSession()
+{
 }
 
 ScreenCastSession::ScreenCastSession(QObject *parent, const QString &appId, const QString &path)
     : Session(parent, appId, path)
+    , m_multipleSources(false)
+    , m_cursorMode(Screencasting::Hidden)
+    , m_sourceTypes(ScreenCastPortal::Any)
+    , m_virtualOutputSize(1920, 1080)
+    , m_virtualOutputScale(1.0)
+    , m_persistMode(ScreenCastRestore::DoNotPersist)
 {
+    connect(WaylandIntegration::waylandIntegration(), &WaylandIntegration::WaylandIntegration::streamChanged, this, &ScreenCastSession::updateStream);
 }
 
 ScreenCastSession::~ScreenCastSession()
 {
+    for (auto &stream : m_streams) {
+        stream.close();
+    }
 }
 
 bool ScreenCastSession::multipleSources() const
@@ -164,14 +292,148 @@ void ScreenCastSession::setMultipleSources(bool multipleSources)
     m_multipleSources = multipleSources;
 }
 
+Screencasting::CursorMode ScreenCastSession::cursorMode() const
+{
+    return m_cursorMode;
+}
+
+void ScreenCastSession::setCursorMode(Screencasting::CursorMode cursorMode)
+{
+    m_cursorMode = cursorMode;
+}
+
+ScreenCastPortal::SourceTypes ScreenCastSession::sourceTypes() const
+{
+    return m_sourceTypes;
+}
+
+void ScreenCastSession::setSourceTypes(ScreenCastPortal::SourceTypes sourceTypes)
+{
+    m_sourceTypes = sourceTypes;
+}
+
+QSize ScreenCastSession::virtualOutputSize() const
+{
+    return m_virtualOutputSize;
+}
+
+void ScreenCastSession::setVirtualOutputSize(const QSize &size)
+{
+    if (size.isValid()) {
+        m_virtualOutputSize = size;
+    }
+}
+
+qreal ScreenCastSession::virtualOutputScale() const
+{
+    return m_virtualOutputScale;
+}
+
+void ScreenCastSession::setVirtualOutputScale(qreal scale)
+{
+    if (scale > 0) {
+        m_virtualOutputScale = scale;
+    }
+}
+
+QString ScreenCastSession::virtualOutputName() const
+{
+    // App ids are empty for host applications and shared between sessions of one application,
+    // the sender and token part of the session handle is neither
+    return QStringLiteral("xdp-kde-") + path().section(QLatin1Char('/'), -2).replace(QLatin1Char('/'), QLatin1Char('-'));
+}
+
+ScreenCastRestore::PersistMode ScreenCastSession::persistMode() const
+{
+    return m_persistMode;
+}
+
+void ScreenCastSession::setPersistMode(ScreenCastRestore::PersistMode persistMode)
+{
+    m_persistMode = persistMode;
+}
+
+QString ScreenCastSession::restoreToken() const
+{
+    return m_restoreToken;
+}
+
+void ScreenCastSession::setRestoreToken(const QString &restoreToken)
+{
+    m_restoreToken = restoreToken;
+}
+
+WaylandIntegration::Streams ScreenCastSession::streams() const
+{
+    return m_streams;
+}
+
+bool ScreenCastSession::hasStream(uint nodeId) const
+{
+    return std::any_of(m_streams.cbegin(), m_streams.cend(), [nodeId] (const WaylandIntegration::Stream &stream) {
+        return stream.nodeId == nodeId;
+    });
+}
+
+void ScreenCastSession::addStreams(const WaylandIntegration::Streams &streams)
+{
+    for (const auto &stream : streams) {
+        const uint nodeId = stream.nodeId;
+        connect(stream.stream, &ScreencastingStream::closed, this, [this, nodeId] {
+            removeStream(nodeId);
+        });
+        m_streams.append(stream);
+    }
+}
+
+void ScreenCastSession::removeStream(uint nodeId)
+{
+    for (auto it = m_streams.begin(), itEnd = m_streams.end(); it != itEnd; ++it) {
+        if (it->nodeId == nodeId) {
+            it->close();
+            m_streams.erase(it);
+            break;
+        }
+    }
+
+    // The compositor stopped the last stream we had, nothing left to share in this session
+    if (m_streams.isEmpty()) {
+        close();
+        Q_EMIT closed();
+    }
+}
+
+void ScreenCastSession::updateStream(uint nodeId, const QVariantMap &properties)
+{
+    auto it = std::find_if(m_streams.begin(), m_streams.end(), [nodeId] (const WaylandIntegration::Stream &stream) {
+        return stream.nodeId == nodeId;
+    });
+
+    if (it == m_streams.end() || it->map == properties) {
+        return;
+    }
+
+    it->map = properties;
+
+    // Emitted on the backend service only, the frontend has no equivalent
+    // signal, so clients connect to org.freedesktop.impl.portal.desktop.kde
+    QDBusMessage message = QDBusMessage::createSignal(path(), QStringLiteral("org.kde.XdgDesktopPortalKde.ScreenCastSession"), QStringLiteral("StreamsChanged"));
+    message << QVariant::fromValue<WaylandIntegration::Streams>(m_streams);
+    QDBusConnection::sessionBus().send(message);
+}
+
 RemoteDesktopSession::RemoteDesktopSession(QObject *parent, const QString &appId, const QString &path)
     : ScreenCastSession(parent, appId, path)
     , m_screenSharingEnabled(false)
+    , m_deviceTypes(RemoteDesktopPortal::None)
+    , m_inputPermissions(RemoteDesktopPortal::None)
 {
 }
 
 RemoteDesktopSession::~RemoteDesktopSession()
 {
+    WaylandIntegration::releaseInput(path());
+    InputLatency::removeSession(path());
 }
 
 RemoteDesktopPortal::DeviceTypes RemoteDesktopSession::deviceTypes() const
@@ -193,3 +455,28 @@ void RemoteDesktopSession::setScreenSharingEnabled(bool enabled)
 {
     m_screenSharingEnabled = enabled;
 }
+
+bool RemoteDesktopSession::isInputEnabled() const
+{
+    return m_inputPermissions != RemoteDesktopPortal::None;
+}
+
+RemoteDesktopPortal::DeviceTypes RemoteDesktopSession::inputPermissions() const
+{
+    return m_inputPermissions;
+}
+
+void RemoteDesktopSession::setInputPermissions(RemoteDesktopPortal::DeviceTypes permissions)
+{
+    m_inputPermissions = permissions;
+}
+
+QDBusUnixFileDescriptor RemoteDesktopSession::openInputChannel()
+{
+    delete m_inputChannel;
+
+    m_inputChannel = new InputChannel(this);
+    connect(m_inputChannel, &InputChannel::closed, m_inputChannel, &QObject::deleteLater);
+
+    return m_inputChannel->open();
+}
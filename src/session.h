@@ -22,9 +22,18 @@
 #define XDG_DESKTOP_PORTAL_KDE_SESSION_H
 
 #include <QObject>
+#include <QDBusUnixFileDescriptor>
 #include <QDBusVirtualObject>
+#include <QPointer>
+#include <QSize>
 
 #include "remotedesktop.h"
+#include "screencast.h"
+#include "screencastrestore.h"
+#include "waylandintegration.h"
+
+class InputChannel;
+class RemoteDesktopSession;
 
 class Session : public QDBusVirtualObject
 {
@@ -35,7 +44,8 @@ public:
 
     enum SessionType {
         ScreenCast = 0,
-        RemoteDesktop = 1
+        RemoteDesktop = 1,
+        InhibitMonitor = 2
     };
 
     bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
@@ -44,8 +54,17 @@ public:
     bool close();
     virtual SessionType type() const = 0;
 
+    QString appId() const { return m_appId; }
+    QString path() const { return m_path; }
+    // Unique bus name of the client which created this session
+    QString owner() const { return m_owner; }
+
     static Session *createSession(QObject *parent, SessionType type, const QString &appId, const QString &path);
     static Session *getSession(const QString &sessionHandle);
+    // Cheap lookup for the input hot path, avoids going through the meta object system
+    static RemoteDesktopSession *getRemoteDesktopSession(const QString &sessionHandle);
+    // Number of sessions closed because their client left the bus
+    static int reapedSessionCount();
 
 Q_SIGNALS:
     void closed();
@@ -53,6 +72,17 @@ Q_SIGNALS:
 private:
     const QString m_appId;
     const QString m_path;
+    const QString m_owner;
+};
+
+class InhibitMonitorSession : public Session
+{
+    Q_OBJECT
+public:
+    explicit InhibitMonitorSession(QObject *parent = nullptr, const QString &appId = QString(), const QString &path = QString());
+    ~InhibitMonitorSession();
+
+    SessionType type() const override { return SessionType::InhibitMonitor; }
 };
 
 class ScreenCastSession : public Session
@@ -65,10 +95,44 @@ public:
     bool multipleSources() const;
     void setMultipleSources(bool multipleSources);
 
+    Screencasting::CursorMode cursorMode() const;
+    void setCursorMode(Screencasting::CursorMode cursorMode);
+
+    ScreenCastPortal::SourceTypes sourceTypes() const;
+    void setSourceTypes(ScreenCastPortal::SourceTypes sourceTypes);
+
+    QSize virtualOutputSize() const;
+    void setVirtualOutputSize(const QSize &size);
+
+    qreal virtualOutputScale() const;
+    void setVirtualOutputScale(qreal scale);
+    // Unique per session, the virtual output's stream is mapped back to it by this name
+    QString virtualOutputName() const;
+
+    ScreenCastRestore::PersistMode persistMode() const;
+    void setPersistMode(ScreenCastRestore::PersistMode persistMode);
+
+    QString restoreToken() const;
+    void setRestoreToken(const QString &restoreToken);
+
+    WaylandIntegration::Streams streams() const;
+    bool hasStream(uint nodeId) const;
+    void addStreams(const WaylandIntegration::Streams &streams);
+
     SessionType type() const override { return SessionType::ScreenCast; }
 
 private:
+    void removeStream(uint nodeId);
+    void updateStream(uint nodeId, const QVariantMap &properties);
+
     bool m_multipleSources;
+    Screencasting::CursorMode m_cursorMode;
+    ScreenCastPortal::SourceTypes m_sourceTypes;
+    QSize m_virtualOutputSize;
+    qreal m_virtualOutputScale;
+    ScreenCastRestore::PersistMode m_persistMode;
+    QString m_restoreToken;
+    WaylandIntegration::Streams m_streams;
     // TODO type
 };
 
@@ -85,11 +149,25 @@ public:
     bool screenSharingEnabled() const;
     void setScreenSharingEnabled(bool enabled);
 
+    bool isInputEnabled() const;
+    // Device types the user granted when starting the session
+    RemoteDesktopPortal::DeviceTypes inputPermissions() const;
+    void setInputPermissions(RemoteDesktopPortal::DeviceTypes permissions);
+    inline bool isInputAllowed(RemoteDesktopPortal::DeviceType type) const
+    {
+        return m_inputPermissions.testFlag(type);
+    }
+
+    // Replaces the previous input channel of this session, if any
+    QDBusUnixFileDescriptor openInputChannel();
+
     SessionType type() const override { return SessionType::RemoteDesktop; }
 
 private:
     bool m_screenSharingEnabled;
     RemoteDesktopPortal::DeviceTypes m_deviceTypes;
+    RemoteDesktopPortal::DeviceTypes m_inputPermissions;
+    QPointer<InputChannel> m_inputChannel;
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_SESSION_H
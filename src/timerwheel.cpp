@@ -0,0 +1,103 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timerwheel.h"
+
+#include <QtMath>
+
+TimerWheel::TimerWheel(int resolution, int slotCount, QObject *parent)
+    : QObject(parent)
+    , m_resolution(resolution)
+    , m_slots(slotCount)
+{
+    m_timer.setInterval(resolution);
+    connect(&m_timer, &QTimer::timeout, this, &TimerWheel::tick);
+}
+
+TimerWheel::~TimerWheel()
+{
+}
+
+void TimerWheel::schedule(const QString &key, int timeout)
+{
+    cancel(key);
+
+    // Part of the current tick has already passed while the timer runs, so the next one
+    // doesn't count. At least one full tick, at most one revolution.
+    const int elapsedTick = m_timer.isActive() ? 1 : 0;
+    const int ticks = qBound(1, qCeil(qreal(timeout) / m_resolution) + elapsedTick, m_slots.size() - 1);
+    const int slot = (m_current + ticks) % m_slots.size();
+
+    m_slots[slot].insert(key);
+    m_slotOfKey.insert(key, slot);
+
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void TimerWheel::cancel(const QString &key)
+{
+    const auto it = m_slotOfKey.find(key);
+    if (it == m_slotOfKey.end()) {
+        return;
+    }
+
+    m_slots[it.value()].remove(key);
+    m_slotOfKey.erase(it);
+
+    if (m_slotOfKey.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+void TimerWheel::clear()
+{
+    for (auto &slot : m_slots) {
+        slot.clear();
+    }
+    m_slotOfKey.clear();
+    m_timer.stop();
+}
+
+bool TimerWheel::isScheduled(const QString &key) const
+{
+    return m_slotOfKey.contains(key);
+}
+
+bool TimerWheel::isEmpty() const
+{
+    return m_slotOfKey.isEmpty();
+}
+
+void TimerWheel::tick()
+{
+    m_current = (m_current + 1) % m_slots.size();
+
+    const QSet<QString> expiredKeys = std::move(m_slots[m_current]);
+    m_slots[m_current].clear();
+
+    for (const QString &key : expiredKeys) {
+        m_slotOfKey.remove(key);
+    }
+
+    if (m_slotOfKey.isEmpty()) {
+        m_timer.stop();
+    }
+
+    for (const QString &key : expiredKeys) {
+        Q_EMIT expired(key);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_TIMER_WHEEL_H
+#define XDG_DESKTOP_PORTAL_KDE_TIMER_WHEEL_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+// Tracks many deadlines with a single timer. Deadlines are rounded up to the wheel's
+// resolution and can't be longer than one revolution of the wheel.
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TimerWheel(int resolution, int slotCount, QObject *parent = nullptr);
+    ~TimerWheel() override;
+
+    // Replaces an already scheduled deadline for the same key
+    void schedule(const QString &key, int timeout);
+    void cancel(const QString &key);
+    void clear();
+
+    bool isScheduled(const QString &key) const;
+    bool isEmpty() const;
+
+Q_SIGNALS:
+    void expired(const QString &key);
+
+private:
+    void tick();
+
+    const int m_resolution;
+    int m_current = 0;
+    QVector<QSet<QString>> m_slots;
+    QHash<QString, int> m_slotOfKey;
+    QTimer m_timer;
+};
+
+#endif // XDG_DESKTOP_PORTAL_KDE_TIMER_WHEEL_H
@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "inputreplay.h"
+
+#include <QIODevice>
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+
+QVector<InputRecording::Record> InputReplay::readRecording(QIODevice *device, QString *errorString)
+{
+    const QByteArray header = device->read(sizeof(InputRecording::magic));
+    if (header != QByteArray(InputRecording::magic, sizeof(InputRecording::magic))) {
+        *errorString = QStringLiteral("not an input recording");
+        return {};
+    }
+
+    const QByteArray content = device->readAll();
+    QVector<InputRecording::Record> records(content.size() / sizeof(InputRecording::Record));
+    memcpy(records.data(), content.constData(), records.size() * sizeof(InputRecording::Record));
+    if (records.isEmpty()) {
+        *errorString = QStringLiteral("recording is empty");
+    }
+    return records;
+}
+
+bool InputReplay::sendToChannel(int fd, const InputEvent &event)
+{
+    // MSG_NOSIGNAL, a closed channel must not kill us with SIGPIPE
+    while (send(fd, &event, sizeof(event), MSG_NOSIGNAL) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            pollfd pfd = {fd, POLLOUT, 0};
+            if (poll(&pfd, 1, 1000) <= 0) {
+                return false;
+            }
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+quint64 InputReplay::count(const QList<uint> &buckets)
+{
+    quint64 total = 0;
+    for (uint count : buckets) {
+        total += count;
+    }
+    return total;
+}
+
+uint InputReplay::percentile(const QList<uint> &buckets, double fraction)
+{
+    const quint64 total = count(buckets);
+
+    quint64 seen = 0;
+    for (int i = 0; i < buckets.count(); ++i) {
+        seen += buckets.at(i);
+        if (total && seen >= fraction * total) {
+            return 1u << i;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDG_DESKTOP_PORTAL_KDE_INPUT_REPLAY_H
+#define XDG_DESKTOP_PORTAL_KDE_INPUT_REPLAY_H
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "inputrecorder.h"
+
+class QIODevice;
+
+// The parts of xdp-kde-input-replay which don't need a running portal
+namespace InputReplay
+{
+// Returns the records of a file written by InputRecorder, empty and an error message otherwise
+QVector<InputRecording::Record> readRecording(QIODevice *device, QString *errorString);
+
+// The channel's fd is non-blocking, this waits for room instead of dropping the event.
+// Returns false if the event was lost, e.g. because the portal closed the channel.
+bool sendToChannel(int fd, const InputEvent &event);
+
+// Number of events in an InputLatency histogram
+quint64 count(const QList<uint> &buckets);
+// Upper bound of the bucket the given percentile falls into, buckets are powers of two µs
+uint percentile(const QList<uint> &buckets, double fraction);
+
+struct Report {
+    int recorded = 0;
+    int sent = 0;
+    // Events the portal dispatched, according to its Dispatch histogram
+    quint64 handled = 0;
+
+    int droppedWhileSending() const { return recorded - sent; }
+    quint64 droppedByPortal() const { return quint64(sent) > handled ? quint64(sent) - handled : 0; }
+};
+}
+
+#endif // XDG_DESKTOP_PORTAL_KDE_INPUT_REPLAY_H
@@ -0,0 +1,325 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays back an input recording made with XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDING against a
+// running portal and reports throughput, dropped and merged events and latency. Run the portal
+// with XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY=1 to get everything but the throughput.
+//
+// The Notify* calls are replayed into an existing session given with --session. The input
+// channel is only handed to the client owning the session, so with --channel the tool creates
+// and starts a session of its own through xdg-desktop-portal instead, which has to be approved
+// in the usual dialog. --app-id has to match the app id xdg-desktop-portal assigned to us,
+// which is empty unless we run sandboxed.
+
+#include "inputevent.h"
+#include "inputlatency.h"
+#include "inputrecorder.h"
+#include "inputreplay.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QDBusReply>
+#include <QDBusUnixFileDescriptor>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include <unistd.h>
+
+static const QString s_portalPath = QStringLiteral("/org/freedesktop/portal/desktop");
+static const QString s_remoteDesktopInterface = QStringLiteral("org.freedesktop.impl.portal.RemoteDesktop");
+
+static QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+// A request on the xdg-desktop-portal frontend, which answers through a Response signal
+class PortalRequest : public QObject
+{
+    Q_OBJECT
+public:
+    // Returns false if the call failed or the user declined
+    bool call(const QString &method, const QVariantList &arguments, QVariantMap options, QVariantMap *results)
+    {
+        static int requestCount = 0;
+        const QString token = QStringLiteral("xdp_kde_input_replay%1").arg(++requestCount);
+        const QString sender = QDBusConnection::sessionBus().baseService().mid(1).replace(QLatin1Char('.'), QLatin1Char('_'));
+        const QString requestPath = QStringLiteral("/org/freedesktop/portal/desktop/request/%1/%2").arg(sender, token);
+
+        // Subscribe before calling, the response may arrive before the reply
+        QDBusConnection::sessionBus().connect(QStringLiteral("org.freedesktop.portal.Desktop"),
+                                              requestPath,
+                                              QStringLiteral("org.freedesktop.portal.Request"),
+                                              QStringLiteral("Response"),
+                                              this,
+                                              SLOT(response(uint, QVariantMap)));
+
+        options.insert(QStringLiteral("handle_token"), token);
+        QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.portal.Desktop"),
+                                                              s_portalPath,
+                                                              QStringLiteral("org.freedesktop.portal.RemoteDesktop"),
+                                                              method);
+        message.setArguments(arguments);
+        message << options;
+
+        const QDBusMessage reply = QDBusConnection::sessionBus().call(message);
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            out() << method << " failed: " << reply.errorMessage() << Qt::endl;
+            return false;
+        }
+
+        m_loop.exec();
+        *results = m_results;
+        return m_response == 0;
+    }
+
+private Q_SLOTS:
+    void response(uint response, const QVariantMap &results)
+    {
+        m_response = response;
+        m_results = results;
+        m_loop.quit();
+    }
+
+private:
+    QEventLoop m_loop;
+    uint m_response = 2;
+    QVariantMap m_results;
+};
+
+// Creates and starts a remote desktop session owned by us, returns its handle or an empty path
+static QDBusObjectPath startOwnSession()
+{
+    QVariantMap results;
+
+    PortalRequest createSession;
+    if (!createSession.call(QStringLiteral("CreateSession"), {}, {{QStringLiteral("session_handle_token"), QStringLiteral("xdp_kde_input_replay")}}, &results)) {
+        return QDBusObjectPath();
+    }
+    const QDBusObjectPath session(results.value(QStringLiteral("session_handle")).toString());
+
+    PortalRequest selectDevices;
+    // Keyboard, pointer and touch screen
+    if (!selectDevices.call(QStringLiteral("SelectDevices"), {QVariant::fromValue(session)}, {{QStringLiteral("types"), 7u}}, &results)) {
+        return QDBusObjectPath();
+    }
+
+    PortalRequest start;
+    if (!start.call(QStringLiteral("Start"), {QVariant::fromValue(session), QString()}, {}, &results)) {
+        return QDBusObjectPath();
+    }
+
+    return session;
+}
+
+static void closeOwnSession(const QDBusObjectPath &session)
+{
+    QDBusConnection::sessionBus().call(QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.portal.Desktop"),
+                                                                      session.path(),
+                                                                      QStringLiteral("org.freedesktop.portal.Session"),
+                                                                      QStringLiteral("Close")));
+}
+
+static QDBusMessage notifyMessage(const QString &service, const QDBusObjectPath &session, const InputEvent &event)
+{
+    const auto message = [&] (const QString &method) {
+        QDBusMessage message = QDBusMessage::createMethodCall(service, s_portalPath, s_remoteDesktopInterface, method);
+        message << QVariant::fromValue(session) << QVariantMap();
+        return message;
+    };
+
+    switch (event.type) {
+    case InputEvent::PointerMotion:
+        return message(QStringLiteral("NotifyPointerMotion")) << event.x << event.y;
+    case InputEvent::PointerMotionAbsolute:
+        return message(QStringLiteral("NotifyPointerMotionAbsolute")) << event.arg << event.x << event.y;
+    case InputEvent::PointerButton:
+        return message(QStringLiteral("NotifyPointerButton")) << static_cast<int>(event.arg) << event.arg2;
+    case InputEvent::PointerAxis: {
+        QDBusMessage axis = QDBusMessage::createMethodCall(service, s_portalPath, s_remoteDesktopInterface, QStringLiteral("NotifyPointerAxis"));
+        axis << QVariant::fromValue(session) << QVariantMap{{QStringLiteral("finish"), event.arg2 != 0}} << event.x << event.y;
+        return axis;
+    }
+    case InputEvent::PointerAxisDiscrete:
+        return message(QStringLiteral("NotifyPointerAxisDiscrete")) << event.arg << static_cast<int>(event.arg2);
+    case InputEvent::KeyboardKeycode:
+        return message(QStringLiteral("NotifyKeyboardKeycode")) << static_cast<int>(event.arg) << event.arg2;
+    case InputEvent::KeyboardKeysym:
+        return message(QStringLiteral("NotifyKeyboardKeysym")) << static_cast<int>(event.arg) << event.arg2;
+    case InputEvent::TouchDown:
+        return message(QStringLiteral("NotifyTouchDown")) << event.arg << event.arg2 << event.x << event.y;
+    case InputEvent::TouchMotion:
+        return message(QStringLiteral("NotifyTouchMotion")) << event.arg << event.arg2 << event.x << event.y;
+    case InputEvent::TouchUp:
+        return message(QStringLiteral("NotifyTouchUp")) << event.arg2;
+    }
+
+    return QDBusMessage();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("xdp-kde-input-replay"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a remote desktop input recording against xdg-desktop-portal-kde"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("recording"), QStringLiteral("File written with XDG_DESKTOP_PORTAL_KDE_INPUT_RECORDING"));
+    parser.addOption({QStringLiteral("session"), QStringLiteral("Handle of a started remote desktop session, not used with --channel"), QStringLiteral("path")});
+    parser.addOption({QStringLiteral("service"), QStringLiteral("Bus name of the portal"), QStringLiteral("name"), QStringLiteral("org.freedesktop.impl.portal.desktop.kde")});
+    parser.addOption({QStringLiteral("max-speed"), QStringLiteral("Send events as fast as possible instead of in real time")});
+    parser.addOption({QStringLiteral("channel"), QStringLiteral("Start a session of our own and send events over its input channel instead of Notify* calls")});
+    parser.addOption({QStringLiteral("app-id"), QStringLiteral("App id xdg-desktop-portal assigned to this tool, for --channel"), QStringLiteral("id")});
+    parser.process(app);
+
+    const bool useChannel = parser.isSet(QStringLiteral("channel"));
+    if (parser.positionalArguments().count() != 1 || useChannel == parser.isSet(QStringLiteral("session"))) {
+        parser.showHelp(1);
+    }
+
+    const QString path = parser.positionalArguments().constFirst();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        out() << "Failed to open " << path << ": " << file.errorString() << Qt::endl;
+        return 1;
+    }
+    QString errorString;
+    const QVector<InputRecording::Record> records = InputReplay::readRecording(&file, &errorString);
+    if (records.isEmpty()) {
+        out() << path << ": " << errorString << Qt::endl;
+        return 1;
+    }
+
+    const QString service = parser.value(QStringLiteral("service"));
+    const bool maxSpeed = parser.isSet(QStringLiteral("max-speed"));
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    QDBusObjectPath session(parser.value(QStringLiteral("session")));
+    int channelFd = -1;
+    if (useChannel) {
+        session = startOwnSession();
+        if (session.path().isEmpty()) {
+            out() << "Failed to start a remote desktop session" << Qt::endl;
+            return 1;
+        }
+
+        QDBusMessage message = QDBusMessage::createMethodCall(service, s_portalPath, s_remoteDesktopInterface, QStringLiteral("ConnectToInputChannel"));
+        message << QVariant::fromValue(session) << parser.value(QStringLiteral("app-id")) << QVariantMap();
+        const QDBusMessage reply = bus.call(message);
+        if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().count() != 2 || reply.arguments().constFirst().toUInt() != 0) {
+            out() << "Failed to connect the input channel, does --app-id match?" << Qt::endl;
+            closeOwnSession(session);
+            return 1;
+        }
+        channelFd = dup(reply.arguments().at(1).value<QDBusUnixFileDescriptor>().fileDescriptor());
+    }
+
+    const QString latencyPath = QStringLiteral("/org/kde/XdgDesktopPortalKde/InputLatency");
+    const QString latencyInterface = QStringLiteral("org.kde.XdgDesktopPortalKde.InputLatency");
+    const auto histogram = [&] (InputLatency::Stage stage) {
+        QDBusMessage message = QDBusMessage::createMethodCall(service, latencyPath, latencyInterface, QStringLiteral("Histogram"));
+        message << session.path() << static_cast<uint>(stage);
+        return QDBusReply<QList<uint>>(bus.call(message));
+    };
+
+    // Start from a clean slate, so only the replayed events are counted
+    const bool latencyEnabled = QDBusReply<void>(bus.call(QDBusMessage::createMethodCall(service, latencyPath, latencyInterface, QStringLiteral("Reset")))).isValid();
+
+    const qint64 firstTimestamp = records.constFirst().timestamp;
+    QElapsedTimer clock;
+    clock.start();
+    InputReplay::Report report;
+    report.recorded = records.count();
+
+    for (const InputRecording::Record &record : records) {
+        if (!maxSpeed) {
+            const qint64 delay = (record.timestamp - firstTimestamp) - clock.nsecsElapsed();
+            if (delay > 0) {
+                QThread::usleep(delay / 1000);
+            }
+        }
+
+        const bool ok = channelFd >= 0 ? InputReplay::sendToChannel(channelFd, record.event) : bus.send(notifyMessage(service, session, record.event));
+        if (ok) {
+            ++report.sent;
+        }
+    }
+
+    // Make sure everything was handled before asking for the numbers
+    QDBusMessage ping = QDBusMessage::createMethodCall(service, s_portalPath, QStringLiteral("org.freedesktop.DBus.Peer"), QStringLiteral("Ping"));
+    bus.call(ping);
+
+    const double seconds = clock.nsecsElapsed() / 1e9;
+    out() << records.count() << " events in " << seconds << "s, " << records.count() / seconds << " events/s" << Qt::endl;
+    out() << "dropped while sending: " << report.droppedWhileSending() << Qt::endl;
+
+    const auto finish = [&] {
+        if (channelFd >= 0) {
+            close(channelFd);
+            closeOwnSession(session);
+        }
+    };
+
+    if (!latencyEnabled) {
+        out() << "No statistics, is the portal running with XDG_DESKTOP_PORTAL_KDE_INPUT_LATENCY=1?" << Qt::endl;
+        finish();
+        return 0;
+    }
+
+    // Channel events reach the main thread asynchronously, give the portal a moment to catch up
+    for (int attempt = 0; attempt < 20; ++attempt) {
+        const QDBusReply<QList<uint>> dispatched = histogram(InputLatency::Dispatch);
+        report.handled = dispatched.isValid() ? InputReplay::count(dispatched.value()) : 0;
+        if (report.handled >= quint64(report.sent)) {
+            break;
+        }
+        QThread::msleep(50);
+    }
+    out() << "dropped by the portal: " << report.droppedByPortal() << Qt::endl;
+
+    const QDBusReply<QVariantMap> statistics = bus.call(QDBusMessage::createMethodCall(service, latencyPath, latencyInterface, QStringLiteral("Statistics")));
+    if (!statistics.isValid()) {
+        finish();
+        return 0;
+    }
+
+    const QVariantMap values = statistics.value();
+    for (auto it = values.constBegin(), itEnd = values.constEnd(); it != itEnd; ++it) {
+        out() << it.key() << ": " << it.value().toULongLong() << Qt::endl;
+    }
+
+    const QStringList stages = {QStringLiteral("lookup"), QStringLiteral("dispatch"), QStringLiteral("flush"), QStringLiteral("total")};
+    for (int stage = 0; stage < stages.count(); ++stage) {
+        const QDBusReply<QList<uint>> buckets = histogram(static_cast<InputLatency::Stage>(stage));
+        if (buckets.isValid()) {
+            out() << stages.at(stage) << " latency: p50 < " << InputReplay::percentile(buckets.value(), 0.5) << "µs, p90 < "
+                  << InputReplay::percentile(buckets.value(), 0.9) << "µs, p99 < " << InputReplay::percentile(buckets.value(), 0.99) << "µs" << Qt::endl;
+        }
+    }
+
+    finish();
+    return 0;
+}
+
+#include "xdp-kde-input-replay.moc"
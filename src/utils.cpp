@@ -17,11 +17,18 @@
 
 #include "utils.h"
 
+#include <KService>
+#include <KSycoca>
 #include <KWindowSystem>
 
+#include <QHash>
 #include <QString>
 #include <QWidget>
 
+typedef QHash<QString, QString> ApplicationNames;
+// app id -> name, unknown ids are cached as an empty name
+Q_GLOBAL_STATIC(ApplicationNames, applicationNames)
+
 void Utils::setParentWindow(QWidget *w, const QString &parent_window)
 {
     if (parent_window.startsWith(QLatin1String("x11:"))) {
@@ -29,3 +36,32 @@ void Utils::setParentWindow(QWidget *w, const QString &parent_window)
         KWindowSystem::setMainWindow(w->windowHandle(), parent_window.midRef(4).toULongLong(nullptr, 16));
     }
 }
+
+QString Utils::applicationName(const QString &appId)
+{
+    if (appId.isEmpty()) {
+        return QString();
+    }
+
+    static const QMetaObject::Connection databaseChangedConnection = QObject::connect(KSycoca::self(), QOverload<>::of(&KSycoca::databaseChanged), [] {
+        applicationNames->clear();
+    });
+    Q_UNUSED(databaseChangedConnection)
+
+    const auto it = applicationNames->constFind(appId);
+    if (it != applicationNames->constEnd()) {
+        return *it;
+    }
+
+    QString name;
+    const KService::Ptr service = KService::serviceByDesktopName(appId);
+    if (service) {
+        name = service->property(QStringLiteral("X-GNOME-FullName"), QVariant::String).toString();
+        if (name.isEmpty()) {
+            name = service->name();
+        }
+    }
+
+    applicationNames->insert(appId, name);
+    return name;
+}
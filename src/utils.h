@@ -25,6 +25,8 @@ class Utils
 {
 public:
     static void setParentWindow(QWidget *w, const QString &parent_window);
+    // User visible name of the application with the given desktop file id, empty if unknown
+    static QString applicationName(const QString &appId);
 };
 
 #endif // XDG_DESKTOP_PORTAL_KDE_UTILS_H
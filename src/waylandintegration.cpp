@@ -20,6 +20,7 @@
 
 #include "waylandintegration.h"
 #include "waylandintegration_p.h"
+#include "inputlatency.h"
 #include "screencasting.h"
 #include "screencast.h"
 
@@ -33,8 +34,12 @@
 #include <KNotification>
 
 #include <QImage>
+#include <QPointer>
+#include <QRect>
 
+#include <KConfigGroup>
 #include <KLocalizedString>
+#include <KSharedConfig>
 
 // KWayland
 #include <KWayland/Client/connection_thread.h>
@@ -45,59 +50,79 @@
 // system
 #include <fcntl.h>
 #include <unistd.h>
+#include <cmath>
+#include <utility>
+
+#include <wayland-util.h>
 
 #include <KWayland/Client/fakeinput.h>
+#include <KWayland/Client/keyboard.h>
+#include <KWayland/Client/seat.h>
 #include <KWayland/Client/output.h>
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKdeWaylandIntegration, "xdp-kde-wayland-integration")
 
 Q_GLOBAL_STATIC(WaylandIntegration::WaylandIntegrationPrivate, globalWaylandIntegration)
 
-static QDebug operator<<(QDebug dbg, const WaylandIntegration::WaylandIntegrationPrivate::Stream &c)
+static QDebug operator<<(QDebug dbg, const WaylandIntegration::Stream &c)
 {
     dbg.nospace() << "Stream("<< c.map << ", " << c.nodeId << ")";
     return dbg.space();
 
 }
 
-void WaylandIntegration::init()
+static QVariantMap outputStreamProperties(const WaylandIntegration::WaylandOutput &output)
 {
-    globalWaylandIntegration->initWayland();
+    return {
+        {QStringLiteral("position"), output.globalPosition()},
+        {QStringLiteral("size"), output.resolution()},
+        {QStringLiteral("source_type"), static_cast<uint>(ScreenCastPortal::Monitor)}
+    };
 }
 
-void WaylandIntegration::authenticate()
+static QVariantMap windowStreamProperties(KWayland::Client::PlasmaWindow *window)
 {
-    globalWaylandIntegration->authenticate();
+    QVariantMap properties = {
+        {QStringLiteral("source_type"), static_cast<uint>(ScreenCastPortal::Window)}
+    };
+
+    if (window) {
+        const QRect geometry = window->geometry();
+        properties.insert(QStringLiteral("position"), geometry.topLeft());
+        properties.insert(QStringLiteral("size"), geometry.size());
+    }
+
+    return properties;
 }
 
-bool WaylandIntegration::isStreamingEnabled()
+void WaylandIntegration::init()
 {
-    return globalWaylandIntegration->isStreamingEnabled();
+    globalWaylandIntegration->initWayland();
 }
 
-bool WaylandIntegration::isStreamingAvailable()
+void WaylandIntegration::authenticate()
 {
-    return globalWaylandIntegration->isStreamingAvailable();
+    globalWaylandIntegration->authenticate();
 }
 
-void WaylandIntegration::startStreamingInput()
+bool WaylandIntegration::isStreamingAvailable()
 {
-    globalWaylandIntegration->startStreamingInput();
+    return globalWaylandIntegration->isStreamingAvailable();
 }
 
-bool WaylandIntegration::startStreamingOutput(quint32 outputName, Screencasting::CursorMode mode)
+WaylandIntegration::Streams WaylandIntegration::startStreaming(const QList<quint32> &outputNames, const QList<QByteArray> &windows, Screencasting::CursorMode mode)
 {
-    return globalWaylandIntegration->startStreamingOutput(outputName, mode);
+    return globalWaylandIntegration->startStreaming(outputNames, windows, mode);
 }
 
-bool WaylandIntegration::startStreamingWindow(const QByteArray &winid)
+WaylandIntegration::Streams WaylandIntegration::startStreamingVirtualOutput(const QString &name, const QSize &size, qreal scale, Screencasting::CursorMode mode)
 {
-    return globalWaylandIntegration->startStreamingWindow(winid);
+    return globalWaylandIntegration->startStreamingVirtualOutput(name, size, scale, mode);
 }
 
-void WaylandIntegration::stopAllStreaming()
+bool WaylandIntegration::isVirtualOutputStreamingAvailable()
 {
-    globalWaylandIntegration->stopAllStreaming();
+    return globalWaylandIntegration->isVirtualOutputStreamingAvailable();
 }
 
 void WaylandIntegration::requestPointerButtonPress(quint32 linuxButton)
@@ -110,14 +135,19 @@ void WaylandIntegration::requestPointerButtonRelease(quint32 linuxButton)
     globalWaylandIntegration->requestPointerButtonRelease(linuxButton);
 }
 
-void WaylandIntegration::requestPointerMotion(const QSizeF &delta)
+void WaylandIntegration::requestPointerMotion(const QString &session, const QSizeF &delta)
+{
+    globalWaylandIntegration->requestPointerMotion(session, delta);
+}
+
+void WaylandIntegration::requestPointerMotionAbsolute(const QString &session, quint32 nodeId, const QPointF &pos)
 {
-    globalWaylandIntegration->requestPointerMotion(delta);
+    globalWaylandIntegration->requestPointerMotionAbsolute(session, nodeId, pos);
 }
 
-void WaylandIntegration::requestPointerMotionAbsolute(const QPointF &pos)
+void WaylandIntegration::requestPointerAxis(const QString &session, const QSizeF &delta, bool finish)
 {
-    globalWaylandIntegration->requestPointerMotionAbsolute(pos);
+    globalWaylandIntegration->requestPointerAxis(session, delta, finish);
 }
 
 void WaylandIntegration::requestPointerAxisDiscrete(Qt::Orientation axis, qreal delta)
@@ -130,14 +160,62 @@ void WaylandIntegration::requestKeyboardKeycode(int keycode, bool state)
     globalWaylandIntegration->requestKeyboardKeycode(keycode, state);
 }
 
-QMap<quint32, WaylandIntegration::WaylandOutput> WaylandIntegration::screens()
+void WaylandIntegration::requestKeyboardKeysym(int keysym, bool state)
+{
+    globalWaylandIntegration->requestKeyboardKeysym(keysym, state);
+}
+
+void WaylandIntegration::requestTouchDown(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos)
+{
+    globalWaylandIntegration->requestTouchDown(session, nodeId, slot, pos);
+}
+
+void WaylandIntegration::requestTouchMotion(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos)
+{
+    globalWaylandIntegration->requestTouchMotion(session, nodeId, slot, pos);
+}
+
+void WaylandIntegration::requestTouchUp(const QString &session, quint32 slot)
+{
+    globalWaylandIntegration->requestTouchUp(session, slot);
+}
+
+void WaylandIntegration::releaseInput(const QString &session)
+{
+    globalWaylandIntegration->releaseInput(session);
+}
+
+WaylandIntegration::InputStatistics WaylandIntegration::inputStatistics()
+{
+    return globalWaylandIntegration->inputStatistics();
+}
+
+WaylandIntegration::WaylandOutputs WaylandIntegration::screens()
 {
     return globalWaylandIntegration->screens();
 }
 
-QVariant WaylandIntegration::streams()
+WaylandIntegration::WaylandOutput::WaylandOutput(quint32 waylandOutputName, quint32 waylandOutputVersion, const KWayland::Client::Output *output)
+    : m_manufacturer(output->manufacturer())
+    , m_model(output->model())
+    , m_globalPosition(output->globalPosition())
+    , m_resolution(output->pixelSize())
+    , m_scale(output->scale())
+    , m_refreshRate(output->refreshRate())
+    , m_waylandOutputName(waylandOutputName)
+    , m_waylandOutputVersion(waylandOutputVersion)
 {
-    return globalWaylandIntegration->streams();
+    setOutputType(m_model);
+}
+
+bool WaylandIntegration::WaylandOutput::operator==(const WaylandOutput &other) const
+{
+    return m_waylandOutputName == other.m_waylandOutputName
+        && m_manufacturer == other.m_manufacturer
+        && m_model == other.m_model
+        && m_globalPosition == other.m_globalPosition
+        && m_resolution == other.m_resolution
+        && m_scale == other.m_scale;
 }
 
 // Thank you kscreen
@@ -165,7 +243,7 @@ void WaylandIntegration::WaylandOutput::setOutputType(const QString &type)
     }
 }
 
-const QDBusArgument &operator >> (const QDBusArgument &arg, WaylandIntegration::WaylandIntegrationPrivate::Stream &stream)
+const QDBusArgument &operator >> (const QDBusArgument &arg, WaylandIntegration::Stream &stream)
 {
     arg.beginStructure();
     arg >> stream.nodeId;
@@ -185,7 +263,7 @@ const QDBusArgument &operator >> (const QDBusArgument &arg, WaylandIntegration::
     return arg;
 }
 
-const QDBusArgument &operator << (QDBusArgument &arg, const WaylandIntegration::WaylandIntegrationPrivate::Stream &stream)
+const QDBusArgument &operator << (QDBusArgument &arg, const WaylandIntegration::Stream &stream)
 {
     arg.beginStructure();
     arg << stream.nodeId;
@@ -195,9 +273,6 @@ const QDBusArgument &operator << (QDBusArgument &arg, const WaylandIntegration::
     return arg;
 }
 
-Q_DECLARE_METATYPE(WaylandIntegration::WaylandIntegrationPrivate::Stream)
-Q_DECLARE_METATYPE(WaylandIntegration::WaylandIntegrationPrivate::Streams)
-
 KWayland::Client::PlasmaWindowManagement * WaylandIntegration::plasmaWindowManagement()
 {
     return globalWaylandIntegration->plasmaWindowManagement();
@@ -214,183 +289,595 @@ WaylandIntegration::WaylandIntegrationPrivate::WaylandIntegrationPrivate()
     , m_connection(nullptr)
     , m_queue(nullptr)
     , m_registry(nullptr)
+    , m_waylandAuthenticationRequested(false)
+    , m_outputs(new QMap<quint32, WaylandOutput>())
     , m_fakeInput(nullptr)
     , m_screencasting(nullptr)
+    , m_streamingAvailable(false)
+    , m_virtualOutputsAvailable(false)
 {
-    qDBusRegisterMetaType<WaylandIntegrationPrivate::Stream>();
-    qDBusRegisterMetaType<WaylandIntegrationPrivate::Streams>();
-}
+    qDBusRegisterMetaType<Stream>();
+    qDBusRegisterMetaType<Streams>();
+
+    connect(this, &WaylandIntegration::outputChanged, this, &WaylandIntegrationPrivate::updateOutputStreams);
+    connect(this, &WaylandIntegration::outputAdded, this, &WaylandIntegrationPrivate::updateOutputStreams);
 
-WaylandIntegration::WaylandIntegrationPrivate::~WaylandIntegrationPrivate() = default;
+    const KConfigGroup remoteDesktopGroup = KSharedConfig::openConfig(QStringLiteral("xdg-desktop-portal-kderc"))->group("RemoteDesktop");
+    m_inputPassthrough = !remoteDesktopGroup.readEntry("CoalescePointerMotion", true);
+
+    m_motionFlushTimer.setSingleShot(true);
+    m_motionFlushTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_motionFlushTimer, &QTimer::timeout, this, &WaylandIntegrationPrivate::flushMotion);
+}
 
-bool WaylandIntegration::WaylandIntegrationPrivate::isStreamingEnabled() const
+WaylandIntegration::WaylandIntegrationPrivate::~WaylandIntegrationPrivate()
 {
-    return !m_streams.isEmpty();
+    m_reconnectTimer.stop();
+    if (m_thread) {
+        m_thread->quit();
+        m_thread->wait();
+    }
 }
 
 bool WaylandIntegration::WaylandIntegrationPrivate::isStreamingAvailable() const
 {
-    return m_screencasting;
+    return m_streamingAvailable;
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::bindOutput(int outputName, int outputVersion)
+bool WaylandIntegration::WaylandIntegrationPrivate::isVirtualOutputStreamingAvailable() const
 {
-    KWayland::Client::Output *output = new KWayland::Client::Output(this);
-    output->setup(m_registry->bindOutput(outputName, outputVersion));
-    m_bindOutputs << output;
+    return m_virtualOutputsAvailable;
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::startStreamingInput()
+KWayland::Client::PlasmaWindow *WaylandIntegration::WaylandIntegrationPrivate::windowForUuid(const QByteArray &uuid) const
 {
-    m_streamInput = true;
+    if (!m_windowManagement) {
+        return nullptr;
+    }
+
+    const auto windows = m_windowManagement->windows();
+    for (KWayland::Client::PlasmaWindow *window : windows) {
+        if (window->uuid() == uuid) {
+            return window;
+        }
+    }
+
+    return nullptr;
 }
 
-bool WaylandIntegration::WaylandIntegrationPrivate::startStreamingWindow(const QByteArray &winid)
+WaylandIntegration::Streams WaylandIntegration::WaylandIntegrationPrivate::startStreaming(const QList<quint32> &outputNames, const QList<QByteArray> &windows, Screencasting::CursorMode mode)
 {
-    return startStreaming(m_screencasting->createWindowStream(QString::fromUtf8(winid), Screencasting::Hidden), {});
+    if (!isStreamingAvailable()) {
+        return {};
+    }
+
+    QVector<QPointer<KWayland::Client::PlasmaWindow>> plasmaWindows;
+    plasmaWindows.reserve(windows.count());
+    for (const QByteArray &winid : windows) {
+        plasmaWindows.append(windowForUuid(winid));
+    }
+
+    // Issue every request up front so that the compositor can process them in one go,
+    // instead of waiting for a full round-trip per selected source
+    return waitForStreams([this, outputNames, windows, plasmaWindows, mode] {
+        QVector<PendingStream> pendingStreams;
+        pendingStreams.reserve(outputNames.count() + windows.count());
+        for (quint32 outputName : outputNames) {
+            const auto output = m_waylandOutputs.value(outputName);
+            if (!output) {
+                qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "Tried to stream non-existing output" << outputName;
+                continue;
+            }
+            PendingStream pendingStream;
+            pendingStream.stream = m_screencasting->createOutputStream(output.data(), mode);
+            pendingStream.outputName = outputName;
+            pendingStreams.append(pendingStream);
+        }
+        for (int i = 0; i < windows.count(); ++i) {
+            PendingStream pendingStream;
+            pendingStream.stream = m_screencasting->createWindowStream(QString::fromUtf8(windows.at(i)), mode);
+            pendingStream.window = plasmaWindows.at(i);
+            pendingStreams.append(pendingStream);
+        }
+        return pendingStreams;
+    });
 }
 
-bool WaylandIntegration::WaylandIntegrationPrivate::startStreamingOutput(quint32 outputName, Screencasting::CursorMode mode)
+WaylandIntegration::Streams WaylandIntegration::WaylandIntegrationPrivate::startStreamingVirtualOutput(const QString &name, const QSize &size, qreal scale, Screencasting::CursorMode mode)
 {
-    auto output = m_outputMap.value(outputName).output();
+    if (!isVirtualOutputStreamingAvailable()) {
+        qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "The compositor does not support streaming virtual outputs";
+        return {};
+    }
 
-    return startStreaming(m_screencasting->createOutputStream(output.data(), mode), output);
+    return waitForStreams([this, name, size, scale, mode] {
+        PendingStream pendingStream;
+        pendingStream.stream = m_screencasting->createVirtualOutputStream(name, size, scale, mode);
+        pendingStream.properties = {
+            {QStringLiteral("size"), size},
+            {QStringLiteral("source_type"), static_cast<uint>(ScreenCastPortal::Virtual)}
+        };
+        pendingStream.virtualOutputName = name;
+        pendingStream.virtualOutputScale = scale;
+        return QVector<PendingStream>{pendingStream};
+    });
 }
 
-bool WaylandIntegration::WaylandIntegrationPrivate::startStreaming(ScreencastingStream *stream, QSharedPointer<KWayland::Client::Output> output)
+WaylandIntegration::Streams WaylandIntegration::WaylandIntegrationPrivate::waitForStreams(const std::function<QVector<PendingStream>()> &createStreams)
 {
     QEventLoop loop;
-    bool streamReady = false;
-    connect(stream, &ScreencastingStream::failed, this, [&] (const QString &error) {
-        qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "failed to start streaming" << stream << error;
-
-        KNotification *notification = new KNotification(QStringLiteral("screencastfailure"), KNotification::CloseOnTimeout);
-        notification->setTitle(i18n("Failed to start screencasting"));
-        notification->setText(error);
-        notification->setIconName(QStringLiteral("dialog-error"));
-        notification->sendEvent();
-
-        streamReady = false;
-        loop.quit();
-    });
-    connect(stream, &ScreencastingStream::created, this, [&] (uint32_t nodeid) {
-        Stream s;
-        s.stream = stream;
-        s.nodeId = nodeid;
-        if (output) {
-            m_streamedScreenPosition = output->globalPosition();
-            s.map = {
-                {QLatin1String("size"), output->pixelSize()},
-                {QLatin1String("source_type"), static_cast<uint>(ScreenCastPortal::Monitor)}
-            };
-        } else {
-            s.map = {
-                {QLatin1String("source_type"), static_cast<uint>(ScreenCastPortal::Window)}
-            };
+    QVector<PendingStream> pendingStreams;
+    Streams createdStreams;
+    int remaining = 0;
+    bool failed = false;
+
+    // Streams are requested and hooked up on the Wayland thread, so that none of their events
+    // can be dispatched before we listen to them. The results are queued back to this loop.
+    runOnWaylandThread([&] {
+        if (!m_screencasting) {
+            return;
         }
-        m_streams.append(s);
-        startStreamingInput();
 
-        connect(stream, &ScreencastingStream::closed, this, [this, nodeid] { stopStreaming(nodeid); });
-        streamReady = true;
-        loop.quit();
-    });
+        pendingStreams = createStreams();
+        remaining = pendingStreams.count();
+        createdStreams.resize(pendingStreams.count());
+
+        for (int i = 0; i < pendingStreams.count(); ++i) {
+            ScreencastingStream *stream = pendingStreams.at(i).stream;
+
+            connect(stream, &ScreencastingStream::failed, &loop, [&, stream] (const QString &error) {
+                qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "failed to start streaming" << stream << error;
+
+                KNotification *notification = new KNotification(QStringLiteral("screencastfailure"), KNotification::CloseOnTimeout);
+                notification->setTitle(i18n("Failed to start screencasting"));
+                notification->setText(error);
+                notification->setIconName(QStringLiteral("dialog-error"));
+                notification->sendEvent();
+
+                failed = true;
+                if (--remaining == 0) {
+                    loop.quit();
+                }
+            });
+            connect(stream, &ScreencastingStream::created, &loop, [&, i, stream] (uint32_t nodeid) {
+                const PendingStream &pendingStream = pendingStreams.at(i);
+                Stream &s = createdStreams[i];
+                s.stream = stream;
+                s.nodeId = nodeid;
+                if (!pendingStream.properties.isEmpty()) {
+                    s.map = pendingStream.properties;
+                } else if (pendingStream.outputName) {
+                    const WaylandOutput output = screens()->value(*pendingStream.outputName);
+                    m_streamedScreenPosition = output.globalPosition();
+                    s.map = outputStreamProperties(output);
+                } else {
+                    s.map = windowStreamProperties(pendingStream.window);
+                }
+
+                if (--remaining == 0) {
+                    loop.quit();
+                }
+            });
+        }
+    }, Qt::BlockingQueuedConnection);
+
+    if (pendingStreams.isEmpty()) {
+        return {};
+    }
+
+    // One deadline for the whole batch rather than one per stream
     QTimer::singleShot(3000, &loop, &QEventLoop::quit);
     loop.exec();
 
-    return streamReady;
+    if (failed || remaining > 0) {
+        if (remaining > 0) {
+            qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "Timed out waiting for" << remaining << "stream(s) to be created";
+        }
+
+        for (const PendingStream &pendingStream : qAsConst(pendingStreams)) {
+            pendingStream.stream->deleteLater();
+        }
+        return {};
+    }
+
+    for (int i = 0; i < createdStreams.count(); ++i) {
+        trackStream(createdStreams.at(i), pendingStreams.at(i));
+    }
+
+    return createdStreams;
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::Stream::close()
+void WaylandIntegration::WaylandIntegrationPrivate::trackStream(const Stream &stream, const PendingStream &pendingStream)
 {
-    stream->deleteLater();
+    const uint nodeId = stream.nodeId;
+
+    StreamSource source;
+    source.outputName = pendingStream.outputName;
+    source.window = pendingStream.window;
+    source.properties = stream.map;
+
+    if (source.outputName) {
+        const WaylandOutput output = screens()->value(*source.outputName);
+        source.globalPosition = QPointF(output.globalPosition());
+        source.scale = qMax(1, output.scale());
+    }
+
+    // The virtual output may not have been announced yet, updateOutputStreams() picks it up then
+    if (!pendingStream.virtualOutputName.isEmpty()) {
+        source.virtualOutputName = pendingStream.virtualOutputName;
+        source.scale = pendingStream.virtualOutputScale;
+        const WaylandOutputs outputs = screens();
+        for (const WaylandOutput &output : *outputs) {
+            if (output.model() == source.virtualOutputName) {
+                bindVirtualOutput(source, output);
+                break;
+            }
+        }
+    }
+
+    // Keep clients informed about resized windows, output changes are handled in updateOutputStreams()
+    if (source.window) {
+        source.globalPosition = QPointF(source.window->geometry().topLeft());
+        source.geometryConnection = connect(source.window, &KWayland::Client::PlasmaWindow::geometryChanged, this, [this, nodeId] {
+            const auto it = m_streamSources.find(nodeId);
+            if (it == m_streamSources.end() || !it->window) {
+                return;
+            }
+            it->globalPosition = QPointF(it->window->geometry().topLeft());
+
+            const QVariantMap properties = windowStreamProperties(it->window);
+            if (properties != it->properties) {
+                it->properties = properties;
+                Q_EMIT streamChanged(nodeId, properties);
+            }
+        });
+    }
+
+    connect(stream.stream, &QObject::destroyed, this, [this, nodeId] {
+        untrackStream(nodeId);
+    });
+
+    m_streamSources.insert(nodeId, source);
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::stopAllStreaming()
+void WaylandIntegration::WaylandIntegrationPrivate::untrackStream(uint nodeId)
 {
-    for (auto & stream : m_streams) {
-        stream.close();
-    }
-    m_streams.clear();
+    const StreamSource source = m_streamSources.take(nodeId);
+    disconnect(source.geometryConnection);
+}
 
-    m_streamInput = false;
-    // First unbound outputs and destroy remote access manager so we no longer receive buffers
+void WaylandIntegration::WaylandIntegrationPrivate::bindVirtualOutput(StreamSource &source, const WaylandOutput &output)
+{
+    source.outputName = output.waylandOutputName();
+    source.globalPosition = QPointF(output.globalPosition());
+    // wl_output rounds fractional scales up, the scale we asked for is the one the stream uses
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::stopStreaming(uint32_t nodeid)
+void WaylandIntegration::WaylandIntegrationPrivate::updateOutputStreams(quint32 outputName)
 {
-    for(auto it = m_streams.begin(), itEnd = m_streams.end(); it != itEnd; ++it) {
-        if (it->nodeId == nodeid) {
-            m_streams.erase(it);
-            break;
+    const WaylandOutput output = screens()->value(outputName);
+    for (auto it = m_streamSources.begin(), itEnd = m_streamSources.end(); it != itEnd; ++it) {
+        if (!it->virtualOutputName.isEmpty()) {
+            // Their stream properties are fixed, only follow where the output is
+            if (it->outputName == outputName || (!it->outputName && output.model() == it->virtualOutputName)) {
+                bindVirtualOutput(*it, output);
+            }
+            continue;
+        }
+        if (it->outputName == outputName) {
+            it->globalPosition = QPointF(output.globalPosition());
+            it->scale = qMax(1, output.scale());
+
+            const QVariantMap properties = outputStreamProperties(output);
+            if (properties != it->properties) {
+                it->properties = properties;
+                Q_EMIT streamChanged(it.key(), properties);
+            }
         }
     }
+}
 
-    if (m_streams.isEmpty()) {
-        stopAllStreaming();
+void WaylandIntegration::Stream::close()
+{
+    if (stream) {
+        stream->deleteLater();
     }
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::requestPointerButtonPress(quint32 linuxButton)
 {
-    if (m_streamInput && m_fakeInput) {
+    flushMotion();
+    sendInput([this, linuxButton] {
         m_fakeInput->requestPointerButtonPress(linuxButton);
-    }
+    });
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::requestPointerButtonRelease(quint32 linuxButton)
 {
-    if (m_streamInput && m_fakeInput) {
+    flushMotion();
+    sendInput([this, linuxButton] {
         m_fakeInput->requestPointerButtonRelease(linuxButton);
+    });
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::requestPointerMotion(const QString &session, const QSizeF &delta)
+{
+    PendingInput &pending = m_pendingInput[session];
+
+    ++m_inputStatistics.pointerMotionEvents;
+    if (pending.pointerPosition || !pending.pointerMotion.isNull()) {
+        ++m_inputStatistics.pointerMotionEventsMerged;
     }
+
+    pending.pointerMotion += delta;
+    queueMotion(pending);
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::requestPointerMotion(const QSizeF &delta)
+void WaylandIntegration::WaylandIntegrationPrivate::requestPointerMotionAbsolute(const QString &session, quint32 nodeId, const QPointF &pos)
 {
-    if (m_streamInput && m_fakeInput) {
-        m_fakeInput->requestPointerMove(delta);
+    PendingInput &pending = m_pendingInput[session];
+
+    ++m_inputStatistics.pointerMotionEvents;
+    if (pending.pointerPosition || !pending.pointerMotion.isNull()) {
+        ++m_inputStatistics.pointerMotionEventsMerged;
     }
+
+    // Whatever relative motion is still pending would be overridden by this anyway
+    pending.pointerPosition = mapFromStream(nodeId, pos);
+    pending.pointerMotion = QSizeF();
+    queueMotion(pending);
 }
 
-void WaylandIntegration::WaylandIntegrationPrivate::requestPointerMotionAbsolute(const QPointF &pos)
+void WaylandIntegration::WaylandIntegrationPrivate::requestPointerAxis(const QString &session, const QSizeF &delta, bool finish)
 {
-    if (m_streamInput && m_fakeInput) {
-        m_fakeInput->requestPointerMoveAbsolute(pos + m_streamedScreenPosition);
+    PendingInput &pending = m_pendingInput[session];
+
+    // The protocol carries wl_fixed_t, so anything below 1/256 would be lost in every single
+    // event. Keep it around until it adds up, and send out what is left once scrolling ends.
+    const auto quantize = [finish] (qreal value) {
+        return finish ? wl_fixed_to_double(wl_fixed_from_double(value)) : std::trunc(value * 256) / 256;
+    };
+
+    pending.scroll += delta;
+    const QSizeF scroll(quantize(pending.scroll.width()), quantize(pending.scroll.height()));
+    pending.scroll = finish ? QSizeF() : pending.scroll - scroll;
+
+    if (scroll.isNull()) {
+        return;
     }
+
+    flushMotion();
+    sendInput([this, scroll] {
+        if (scroll.width() != 0) {
+            m_fakeInput->requestPointerAxis(Qt::Horizontal, scroll.width());
+        }
+        if (scroll.height() != 0) {
+            m_fakeInput->requestPointerAxis(Qt::Vertical, scroll.height());
+        }
+    });
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::requestPointerAxisDiscrete(Qt::Orientation axis, qreal delta)
 {
-    if (m_streamInput && m_fakeInput) {
+    flushMotion();
+    sendInput([this, axis, delta] {
         m_fakeInput->requestPointerAxis(axis, delta);
-    }
+    });
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::requestKeyboardKeycode(int keycode, bool state)
 {
-    if (m_streamInput && m_fakeInput) {
+    flushMotion();
+    sendInput([this, keycode, state] {
         if (state) {
             m_fakeInput->requestKeyboardKeyPress(keycode);
         } else {
             m_fakeInput->requestKeyboardKeyRelease(keycode);
         }
+    });
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::requestKeyboardKeysym(int keysym, bool state)
+{
+    flushMotion();
+    sendInput([this, keysym, state] {
+        const std::optional<Keymap::Key> key = m_keymap.lookup(keysym);
+        if (!key) {
+            qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "No key produces keysym" << keysym;
+            return;
+        }
+
+        // Modifiers go down before the key and come up after it
+        if (state) {
+            for (quint32 modifier : key->modifiers) {
+                m_fakeInput->requestKeyboardKeyPress(modifier);
+            }
+            m_fakeInput->requestKeyboardKeyPress(key->keycode);
+        } else {
+            m_fakeInput->requestKeyboardKeyRelease(key->keycode);
+            for (auto it = key->modifiers.crbegin(), itEnd = key->modifiers.crend(); it != itEnd; ++it) {
+                m_fakeInput->requestKeyboardKeyRelease(*it);
+            }
+        }
+    });
+}
+
+WaylandIntegration::InputStatistics WaylandIntegration::WaylandIntegrationPrivate::inputStatistics() const
+{
+    return m_inputStatistics;
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::requestTouchDown(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos)
+{
+    PendingInput &pending = m_pendingInput[session];
+    if (pending.touchIds.contains(slot)) {
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Touch slot" << slot << "is already down";
+        return;
     }
+
+    quint32 touchId = 0;
+    while (m_usedTouchIds.contains(touchId)) {
+        ++touchId;
+    }
+    m_usedTouchIds.insert(touchId);
+    pending.touchIds.insert(slot, touchId);
+
+    flushMotion();
+    const QPointF globalPos = mapFromStream(nodeId, pos);
+    sendInput([this, touchId, globalPos] {
+        m_fakeInput->requestTouchDown(touchId, globalPos);
+        m_fakeInput->requestTouchFrame();
+    });
 }
 
-QMap<quint32, WaylandIntegration::WaylandOutput> WaylandIntegration::WaylandIntegrationPrivate::screens()
+void WaylandIntegration::WaylandIntegrationPrivate::requestTouchMotion(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos)
 {
-    return m_outputMap;
+    PendingInput &pending = m_pendingInput[session];
+    const auto it = pending.touchIds.constFind(slot);
+    if (it == pending.touchIds.constEnd()) {
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Touch slot" << slot << "is not down";
+        return;
+    }
+
+    ++m_inputStatistics.touchMotionEvents;
+    if (pending.touchMotion.contains(*it)) {
+        ++m_inputStatistics.touchMotionEventsMerged;
+    }
+
+    pending.touchMotion.insert(*it, mapFromStream(nodeId, pos));
+    queueMotion(pending);
 }
 
-QVariant WaylandIntegration::WaylandIntegrationPrivate::streams()
+void WaylandIntegration::WaylandIntegrationPrivate::requestTouchUp(const QString &session, quint32 slot)
 {
-    return QVariant::fromValue<WaylandIntegrationPrivate::Streams>(m_streams);
+    PendingInput &pending = m_pendingInput[session];
+    if (!pending.touchIds.contains(slot)) {
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Touch slot" << slot << "is not down";
+        return;
+    }
+
+    flushMotion();
+    const quint32 touchId = pending.touchIds.take(slot);
+    m_usedTouchIds.remove(touchId);
+    sendInput([this, touchId] {
+        m_fakeInput->requestTouchUp(touchId);
+        m_fakeInput->requestTouchFrame();
+    });
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::releaseInput(const QString &session)
+{
+    const auto it = m_pendingInput.find(session);
+    if (it == m_pendingInput.end()) {
+        return;
+    }
+
+    // Don't leave fingers on the screen of a session which is gone
+    const QList<quint32> touchIds = it->touchIds.values();
+    m_pendingInput.erase(it);
+    if (touchIds.isEmpty()) {
+        return;
+    }
+
+    flushMotion();
+    for (quint32 touchId : touchIds) {
+        m_usedTouchIds.remove(touchId);
+    }
+    sendInput([this, touchIds] {
+        for (quint32 touchId : touchIds) {
+            m_fakeInput->requestTouchUp(touchId);
+        }
+        m_fakeInput->requestTouchFrame();
+    });
+}
+
+QPointF WaylandIntegration::WaylandIntegrationPrivate::mapFromStream(quint32 nodeId, const QPointF &pos) const
+{
+    const auto it = m_streamSources.constFind(nodeId);
+    if (it == m_streamSources.constEnd() || !it->globalPosition) {
+        return m_streamedScreenPosition + pos;
+    }
+
+    // Streams are in device pixels, the compositor wants logical coordinates
+    return *it->globalPosition + pos / it->scale;
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::queueMotion(PendingInput &pending)
+{
+    // Merged motion is as late as its oldest part
+    if (!pending.receipt) {
+        pending.latencySession = InputLatency::currentSession();
+        pending.receipt = InputLatency::currentReceipt();
+    }
+
+    if (m_inputPassthrough) {
+        flushMotion();
+    } else if (!m_motionFlushTimer.isActive()) {
+        m_motionFlushTimer.start(motionFlushInterval());
+    }
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::flushMotion()
+{
+    m_motionFlushTimer.stop();
+
+    // Every session's motion goes out in its own batch, so latency is attributed to the right one
+    for (auto it = m_pendingInput.begin(), itEnd = m_pendingInput.end(); it != itEnd; ++it) {
+        PendingInput &pending = *it;
+        const std::optional<QPointF> position = std::exchange(pending.pointerPosition, std::nullopt);
+        const QSizeF delta = std::exchange(pending.pointerMotion, QSizeF());
+        const QHash<quint32, QPointF> touchMotion = std::exchange(pending.touchMotion, {});
+        const QString session = std::exchange(pending.latencySession, QString());
+        const qint64 receivedAt = std::exchange(pending.receipt, 0);
+        if (!position && delta.isNull() && touchMotion.isEmpty()) {
+            continue;
+        }
+
+        sendInput([this, position, delta, touchMotion] {
+            if (position) {
+                m_fakeInput->requestPointerMoveAbsolute(*position);
+            }
+            if (!delta.isNull()) {
+                m_fakeInput->requestPointerMove(delta);
+            }
+            if (!touchMotion.isEmpty()) {
+                for (auto it = touchMotion.constBegin(), itEnd = touchMotion.constEnd(); it != itEnd; ++it) {
+                    m_fakeInput->requestTouchMotion(it.key(), it.value());
+                }
+                m_fakeInput->requestTouchFrame();
+            }
+        }, session, receivedAt);
+    }
+}
+
+int WaylandIntegration::WaylandIntegrationPrivate::motionFlushInterval() const
+{
+    // Nothing can show the motion faster than the fastest output refreshes
+    int refreshRate = 0;
+    const WaylandOutputs outputs = screens();
+    for (const WaylandOutput &output : *outputs) {
+        refreshRate = qMax(refreshRate, output.refreshRate());
+    }
+
+    return refreshRate > 0 ? qMax(1, 1000000 / refreshRate) : 16;
+}
+
+WaylandIntegration::WaylandOutputs WaylandIntegration::WaylandIntegrationPrivate::screens() const
+{
+    QMutexLocker locker(&m_outputsMutex);
+    return m_outputs;
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::authenticate()
 {
     if (!m_waylandAuthenticationRequested) {
-        m_fakeInput->authenticate(i18n("xdg-desktop-portals-kde"), i18n("Remote desktop"));
+        const QString applicationName = i18n("xdg-desktop-portals-kde");
+        const QString reason = i18n("Remote desktop");
+        runOnWaylandThread([this, applicationName, reason] {
+            if (m_fakeInput) {
+                m_fakeInput->authenticate(applicationName, reason);
+            }
+        });
         m_waylandAuthenticationRequested = true;
     }
 }
@@ -401,92 +888,282 @@ KWayland::Client::PlasmaWindowManagement * WaylandIntegration::WaylandIntegratio
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::initWayland()
+{
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &WaylandIntegrationPrivate::connectToCompositor);
+
+    connectToCompositor();
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::connectToCompositor()
 {
     m_thread = new QThread(this);
+    m_thread->setObjectName(QStringLiteral("WaylandIntegration"));
     m_connection = new KWayland::Client::ConnectionThread;
+    m_threadContext = new QObject;
 
-    connect(m_connection, &KWayland::Client::ConnectionThread::connected, this, &WaylandIntegrationPrivate::setupRegistry, Qt::QueuedConnection);
+    connect(m_connection, &KWayland::Client::ConnectionThread::connected, m_threadContext, [this] { setupRegistry(); });
+    connect(m_connection, &KWayland::Client::ConnectionThread::connected, this, [this] {
+        if (m_reconnectAttempts > 0) {
+            qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Reconnected to the compositor after" << m_reconnectAttempts << "attempt(s)";
+        }
+        m_reconnectAttempts = 0;
+        setupWindowManagement();
+    });
     connect(m_connection, &KWayland::Client::ConnectionThread::connectionDied, this, [this] {
-        if (m_queue) {
-            delete m_queue;
-            m_queue = nullptr;
+        qCWarning(XdgDesktopPortalKdeWaylandIntegration) << "Lost connection to the compositor";
+        teardownWayland();
+        disconnectFromCompositor();
+        scheduleReconnect();
+    });
+    connect(m_connection, &KWayland::Client::ConnectionThread::failed, this, [this] {
+        teardownWayland();
+        disconnectFromCompositor();
+        // Only keep trying if we had a connection before, otherwise there is no compositor to wait for
+        if (m_reconnectAttempts > 0) {
+            scheduleReconnect();
         }
+    });
 
+    m_thread->start();
+    m_threadContext->moveToThread(m_thread);
+    m_connection->moveToThread(m_thread);
+    m_connection->initConnection();
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::disconnectFromCompositor()
+{
+    if (m_connection) {
         m_connection->deleteLater();
         m_connection = nullptr;
+    }
+
+    if (m_thread) {
+        m_thread->quit();
+        if (!m_thread->wait(3000)) {
+            m_thread->terminate();
+            m_thread->wait();
+        }
+        delete m_thread;
+        m_thread = nullptr;
+    }
+}
 
-        if (m_thread) {
-            m_thread->quit();
-            if (!m_thread->wait(3000)) {
-                m_thread->terminate();
-                m_thread->wait();
+void WaylandIntegration::WaylandIntegrationPrivate::scheduleReconnect()
+{
+    // 250ms, 500ms, 1s, ... capped at 30s, the compositor usually comes back within the first few attempts
+    const int interval = qMin(250 << qMin(m_reconnectAttempts, 7), 30000);
+    ++m_reconnectAttempts;
+
+    qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Reconnecting to the compositor in" << interval << "ms";
+    m_reconnectTimer.start(interval);
+}
+
+void WaylandIntegration::WaylandIntegrationPrivate::teardownWayland()
+{
+    m_streamingAvailable = false;
+    m_virtualOutputsAvailable = false;
+    m_pendingInput.clear();
+    m_usedTouchIds.clear();
+
+    if (m_threadContext) {
+        QObject *threadContext = m_threadContext;
+        runOnWaylandThread([this, threadContext] {
+            // The display is gone, only destroy the proxies, releasing them would talk to it.
+            // The streams die with the connection, destroying them lets their sessions know
+            // so clients can restart them.
+            if (m_screencasting) {
+                const auto streams = m_screencasting->findChildren<ScreencastingStream *>(QString(), Qt::FindDirectChildrenOnly);
+                for (ScreencastingStream *stream : streams) {
+                    stream->destroy();
+                }
+                m_screencasting->destroy();
+            }
+            for (const auto &output : qAsConst(m_waylandOutputs)) {
+                output->destroy();
+            }
+            if (m_keyboard) {
+                m_keyboard->destroy();
             }
-            delete m_thread;
-            m_thread = nullptr;
+            if (m_seat) {
+                m_seat->destroy();
+            }
+            if (m_fakeInput) {
+                m_fakeInput->destroy();
+            }
+            if (m_registry) {
+                m_registry->destroy();
+            }
+            if (m_queue) {
+                m_queue->destroy();
+            }
+
+            m_waylandOutputs.clear();
+            m_fakeInput = nullptr;
+            m_keyboard = nullptr;
+            m_seat = nullptr;
+            m_keymap = Keymap();
+            m_screencasting = nullptr;
+            m_registry = nullptr;
+            m_queue = nullptr;
+            delete threadContext;
+        }, Qt::BlockingQueuedConnection);
+        m_threadContext = nullptr;
+    }
+
+    WaylandOutputs outputs;
+    {
+        QMutexLocker locker(&m_outputsMutex);
+        outputs = m_outputs;
+        m_outputs.reset(new QMap<quint32, WaylandOutput>());
+    }
+    for (auto it = outputs->constBegin(), itEnd = outputs->constEnd(); it != itEnd; ++it) {
+        Q_EMIT outputRemoved(it.key());
+    }
+
+    if (m_windowManagement) {
+        const auto windows = m_windowManagement->windows();
+        for (KWayland::Client::PlasmaWindow *window : windows) {
+            window->destroy();
         }
-    });
-    connect(m_connection, &KWayland::Client::ConnectionThread::failed, this, [this] {
-        m_thread->quit();
-        m_thread->wait();
-    });
+        m_windowManagement->destroy();
+    }
+    if (m_windowManagementRegistry) {
+        m_windowManagementRegistry->destroy();
+    }
+    if (m_windowManagementQueue) {
+        m_windowManagementQueue->destroy();
+    }
 
-    m_thread->start();
-    m_connection->moveToThread(m_thread);
-    m_connection->initConnection();
+    delete m_windowManagement;
+    m_windowManagement = nullptr;
+    delete m_windowManagementRegistry;
+    m_windowManagementRegistry = nullptr;
+    delete m_windowManagementQueue;
+    m_windowManagementQueue = nullptr;
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::addOutput(quint32 name, quint32 version)
 {
-    QSharedPointer<KWayland::Client::Output> output(new KWayland::Client::Output(this));
+    QSharedPointer<KWayland::Client::Output> output(new KWayland::Client::Output);
     output->setup(m_registry->bindOutput(name, version));
+    m_waylandOutputs.insert(name, output);
 
-    connect(output.data(), &KWayland::Client::Output::changed, this, [this, name, version, output] () {
-        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Adding output:";
-        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    manufacturer: " << output->manufacturer();
-        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    model: " << output->model();
-        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    resolution: " << output->pixelSize();
+    const QWeakPointer<KWayland::Client::Output> weakOutput = output;
+    connect(output.data(), &KWayland::Client::Output::changed, m_threadContext, [this, name, version, weakOutput] () {
+        const QSharedPointer<KWayland::Client::Output> output = weakOutput.toStrongRef();
+        if (output) {
+            setOutput(WaylandOutput(name, version, output.data()));
+        }
+    });
+}
+void WaylandIntegration::WaylandIntegrationPrivate::setOutput(const WaylandOutput &output)
+{
+    bool added = false;
+    bool changed = true;
+    {
+        QMutexLocker locker(&m_outputsMutex);
+        const auto it = m_outputs->constFind(output.waylandOutputName());
+        if (it != m_outputs->constEnd() && *it == output) {
+            // Nothing we expose has changed, e.g. only the physical size
+            if (it->refreshRate() == output.refreshRate()) {
+                return;
+            }
+            // Only the motion flush interval cares about the refresh rate, it reads the snapshot
+            changed = false;
+        }
+        added = it == m_outputs->constEnd();
 
-        WaylandOutput portalOutput;
-        portalOutput.setOutput(output);
-        portalOutput.setWaylandOutputName(name);
-        portalOutput.setWaylandOutputVersion(version);
+        auto outputs = QSharedPointer<QMap<quint32, WaylandOutput>>::create(*m_outputs);
+        outputs->insert(output.waylandOutputName(), output);
+        m_outputs = outputs;
+    }
 
-        m_outputMap.insert(name, portalOutput);
-    });
+    if (!changed) {
+        return;
+    }
+
+    if (added) {
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Adding output:";
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    manufacturer: " << output.manufacturer();
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    model: " << output.model();
+        qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    resolution: " << output.resolution();
+        Q_EMIT outputAdded(output.waylandOutputName());
+    } else {
+        Q_EMIT outputChanged(output.waylandOutputName());
+    }
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::removeOutput(quint32 name)
 {
-    WaylandOutput output = m_outputMap.take(name);
+    m_waylandOutputs.remove(name);
+
+    WaylandOutput output;
+    {
+        QMutexLocker locker(&m_outputsMutex);
+        if (!m_outputs->contains(name)) {
+            return;
+        }
+
+        auto outputs = QSharedPointer<QMap<quint32, WaylandOutput>>::create(*m_outputs);
+        output = outputs->take(name);
+        m_outputs = outputs;
+    }
+
     qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Removing output:";
     qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    manufacturer: " << output.manufacturer();
     qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "    model: " << output.model();
+    Q_EMIT outputRemoved(name);
 }
 
 void WaylandIntegration::WaylandIntegrationPrivate::setupRegistry()
 {
-    m_queue = new KWayland::Client::EventQueue(this);
+    m_queue = new KWayland::Client::EventQueue(m_threadContext);
     m_queue->setup(m_connection);
 
-    m_registry = new KWayland::Client::Registry(this);
+    m_registry = new KWayland::Client::Registry(m_threadContext);
 
-    connect(m_registry, &KWayland::Client::Registry::fakeInputAnnounced, this, [this] (quint32 name, quint32 version) {
-        m_fakeInput = m_registry->createFakeInput(name, version, this);
+    connect(m_registry, &KWayland::Client::Registry::fakeInputAnnounced, m_threadContext, [this] (quint32 name, quint32 version) {
+        m_fakeInput = m_registry->createFakeInput(name, version, m_threadContext);
+        // Authentication does not survive a reconnect
+        if (m_waylandAuthenticationRequested) {
+            m_fakeInput->authenticate(i18n("xdg-desktop-portals-kde"), i18n("Remote desktop"));
+        }
+    });
+    connect(m_registry, &KWayland::Client::Registry::seatAnnounced, m_threadContext, [this] (quint32 name, quint32 version) {
+        if (m_seat) {
+            return;
+        }
+        // The keyboard is only bound for its keymap, which keysyms are translated with
+        m_seat = m_registry->createSeat(name, version, m_threadContext);
+        connect(m_seat, &KWayland::Client::Seat::hasKeyboardChanged, m_threadContext, [this] (bool hasKeyboard) {
+            if (hasKeyboard && !m_keyboard) {
+                m_keyboard = m_seat->createKeyboard(m_threadContext);
+                connect(m_keyboard, &KWayland::Client::Keyboard::keymapChanged, m_threadContext, [this] (int fd, quint32 size) {
+                    m_keymap.load(fd, size);
+                });
+            } else if (!hasKeyboard && m_keyboard) {
+                delete m_keyboard;
+                m_keyboard = nullptr;
+            }
+        });
+    });
+    connect(m_registry, &KWayland::Client::Registry::outputAnnounced, m_threadContext, [this] (quint32 name, quint32 version) {
+        addOutput(name, version);
+    });
+    connect(m_registry, &KWayland::Client::Registry::outputRemoved, m_threadContext, [this] (quint32 name) {
+        removeOutput(name);
     });
-    connect(m_registry, &KWayland::Client::Registry::outputAnnounced, this, &WaylandIntegrationPrivate::addOutput);
-    connect(m_registry, &KWayland::Client::Registry::outputRemoved, this, &WaylandIntegrationPrivate::removeOutput);
 
-    connect(m_registry, &KWayland::Client::Registry::interfaceAnnounced, this, [this] (const QByteArray &interfaceName, quint32 name, quint32 version) {
+    connect(m_registry, &KWayland::Client::Registry::interfaceAnnounced, m_threadContext, [this] (const QByteArray &interfaceName, quint32 name, quint32 version) {
         if (interfaceName != "zkde_screencast_unstable_v1")
             return;
-        m_screencasting = new Screencasting(m_registry, name, version, this);
-    });
-    connect(m_registry, &KWayland::Client::Registry::plasmaWindowManagementAnnounced, this, [this] (quint32 name, quint32 version) {
-        m_windowManagement = m_registry->createPlasmaWindowManagement(name, version, this);
-        Q_EMIT waylandIntegration()->plasmaWindowManagementInitialized();
+        m_screencasting = new Screencasting(m_registry, name, version, m_threadContext);
+        m_virtualOutputsAvailable = m_screencasting->supportsVirtualOutputs();
+        m_streamingAvailable = true;
     });
 
-    connect(m_registry, &KWayland::Client::Registry::interfacesAnnounced, this, [this] {
+    connect(m_registry, &KWayland::Client::Registry::interfacesAnnounced, m_threadContext, [this] {
         m_registryInitialized = true;
         qCDebug(XdgDesktopPortalKdeWaylandIntegration) << "Registry initialized";
     });
@@ -495,3 +1172,20 @@ void WaylandIntegration::WaylandIntegrationPrivate::setupRegistry()
     m_registry->setEventQueue(m_queue);
     m_registry->setup();
 }
+
+void WaylandIntegration::WaylandIntegrationPrivate::setupWindowManagement()
+{
+    m_windowManagementQueue = new KWayland::Client::EventQueue(this);
+    m_windowManagementQueue->setup(m_connection);
+
+    m_windowManagementRegistry = new KWayland::Client::Registry(this);
+
+    connect(m_windowManagementRegistry, &KWayland::Client::Registry::plasmaWindowManagementAnnounced, this, [this] (quint32 name, quint32 version) {
+        m_windowManagement = m_windowManagementRegistry->createPlasmaWindowManagement(name, version, this);
+        Q_EMIT waylandIntegration()->plasmaWindowManagementInitialized();
+    });
+
+    m_windowManagementRegistry->create(m_connection);
+    m_windowManagementRegistry->setEventQueue(m_windowManagementQueue);
+    m_windowManagementRegistry->setup();
+}
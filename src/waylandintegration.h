@@ -21,10 +21,16 @@
 #ifndef XDG_DESKTOP_PORTAL_KDE_WAYLAND_INTEGRATION_H
 #define XDG_DESKTOP_PORTAL_KDE_WAYLAND_INTEGRATION_H
 
+#include <QMap>
 #include <QObject>
 #include <QPoint>
+#include <QPointF>
+#include <QPointer>
+#include <QSharedPointer>
 #include <QSize>
+#include <QSizeF>
 #include <QVariant>
+#include <QVector>
 
 #include <KWayland/Client/output.h>
 #include <screencasting.h>
@@ -47,32 +53,62 @@ public:
         Monitor,
         Television
     };
-    QString manufacturer() const { return m_output->manufacturer(); }
-    QString model() const { return m_output->model(); }
-    QPoint globalPosition() const { return m_output->globalPosition(); }
-    QSize resolution() const { return m_output->pixelSize(); }
-    OutputType outputType() const { return m_outputType; }
 
-    QSharedPointer<KWayland::Client::Output> output() const { return m_output; }
-    void setOutput(const QSharedPointer<KWayland::Client::Output> &output) {
-        m_output = output;
-        setOutputType(output->model());
-    }
+    WaylandOutput() = default;
+    // Copies what we need, the snapshot must not keep the Wayland thread's Output alive
+    WaylandOutput(quint32 waylandOutputName, quint32 waylandOutputVersion, const KWayland::Client::Output *output);
+
+    QString manufacturer() const { return m_manufacturer; }
+    QString model() const { return m_model; }
+    QPoint globalPosition() const { return m_globalPosition; }
+    QSize resolution() const { return m_resolution; }
+    int scale() const { return m_scale; }
+    // In mHz
+    int refreshRate() const { return m_refreshRate; }
+    OutputType outputType() const { return m_outputType; }
 
-    void setWaylandOutputName(int outputName) { m_waylandOutputName = outputName; }
-    int waylandOutputName() const { return m_waylandOutputName; }
+    // Needed for later output binding
+    quint32 waylandOutputName() const { return m_waylandOutputName; }
+    quint32 waylandOutputVersion() const { return m_waylandOutputVersion; }
 
-    void setWaylandOutputVersion(int outputVersion) { m_waylandOutputVersion = outputVersion; }
-    int waylandOutputVersion() const { return m_waylandOutputVersion; }
+    // Compares what affects streams and the screen chooser, not the refresh rate
+    bool operator==(const WaylandOutput &other) const;
+    bool operator!=(const WaylandOutput &other) const { return !(*this == other); }
 
 private:
     void setOutputType(const QString &model);
+
+    QString m_manufacturer;
+    QString m_model;
+    QPoint m_globalPosition;
+    QSize m_resolution;
+    int m_scale = 1;
+    int m_refreshRate = 0;
     OutputType m_outputType = Monitor;
-    QSharedPointer<KWayland::Client::Output> m_output;
 
-    // Needed for later output binding
-    int m_waylandOutputName;
-    int m_waylandOutputVersion;
+    quint32 m_waylandOutputName = 0;
+    quint32 m_waylandOutputVersion = 0;
+};
+
+// Immutable snapshot of the known outputs, replaced as a whole whenever an output changes
+typedef QSharedPointer<const QMap<quint32, WaylandOutput>> WaylandOutputs;
+
+struct Stream {
+    QPointer<ScreencastingStream> stream;
+    uint nodeId;
+    QVariantMap map;
+
+    void close();
+};
+typedef QVector<Stream> Streams;
+
+struct InputStatistics {
+    // Pointer motion requests received from clients
+    quint64 pointerMotionEvents = 0;
+    // How many of them were folded into another one before reaching the compositor
+    quint64 pointerMotionEventsMerged = 0;
+    quint64 touchMotionEvents = 0;
+    quint64 touchMotionEventsMerged = 0;
 };
 
 class WaylandIntegration : public QObject
@@ -81,28 +117,43 @@ class WaylandIntegration : public QObject
 Q_SIGNALS:
     void newBuffer(uint8_t *screenData);
     void plasmaWindowManagementInitialized();
+    void outputAdded(quint32 name);
+    void outputChanged(quint32 name);
+    void outputRemoved(quint32 name);
+    void streamChanged(quint32 nodeId, const QVariantMap &properties);
 };
 
     void authenticate();
 
-    bool isStreamingEnabled();
     bool isStreamingAvailable();
+    bool isVirtualOutputStreamingAvailable();
 
-    void startStreamingInput();
-    bool startStreamingOutput(quint32 outputName, Screencasting::CursorMode mode);
-    bool startStreamingWindow(const QByteArray &winid);
-    void stopAllStreaming();
+    Streams startStreaming(const QList<quint32> &outputNames, const QList<QByteArray> &windows, Screencasting::CursorMode mode);
+    Streams startStreamingVirtualOutput(const QString &name, const QSize &size, qreal scale, Screencasting::CursorMode mode);
 
     void requestPointerButtonPress(quint32 linuxButton);
     void requestPointerButtonRelease(quint32 linuxButton);
-    void requestPointerMotion(const QSizeF &delta);
-    void requestPointerMotionAbsolute(const QPointF &pos);
+    // Motion, scrolling and touch points are batched per session, identified by its handle
+    void requestPointerMotion(const QString &session, const QSizeF &delta);
+    // Position is relative to the stream with the given PipeWire node id
+    void requestPointerMotionAbsolute(const QString &session, quint32 nodeId, const QPointF &pos);
+    void requestPointerAxis(const QString &session, const QSizeF &delta, bool finish);
     void requestPointerAxisDiscrete(Qt::Orientation axis, qreal delta);
 
     void requestKeyboardKeycode(int keycode, bool state);
+    void requestKeyboardKeysym(int keysym, bool state);
+
+    // Positions are relative to the stream with the given PipeWire node id
+    void requestTouchDown(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos);
+    void requestTouchMotion(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos);
+    void requestTouchUp(const QString &session, quint32 slot);
 
-    QMap<quint32, WaylandOutput> screens();
-    QVariant streams();
+    // Drops pending input of a closed session and lifts its touch points
+    void releaseInput(const QString &session);
+
+    InputStatistics inputStatistics();
+
+    WaylandOutputs screens();
 
     void init();
 
@@ -111,6 +162,9 @@ Q_SIGNALS:
     WaylandIntegration *waylandIntegration();
 }
 
+Q_DECLARE_METATYPE(WaylandIntegration::Stream)
+Q_DECLARE_METATYPE(WaylandIntegration::Streams)
+
 #endif // XDG_DESKTOP_PORTAL_KDE_WAYLAND_INTEGRATION_H
 
 
@@ -21,12 +21,23 @@
 #ifndef XDG_DESKTOP_PORTAL_KDE_WAYLAND_INTEGRATION_P_H
 #define XDG_DESKTOP_PORTAL_KDE_WAYLAND_INTEGRATION_P_H
 
+#include "inputlatency.h"
+#include "keymap.h"
 #include "waylandintegration.h"
 
 #include <QDateTime>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
 #include <QVector>
 
+#include <atomic>
+#include <functional>
+#include <optional>
+
 class Screencasting;
 class ScreencastingStream;
 
@@ -38,6 +49,8 @@ namespace KWayland {
         class PlasmaWindow;
         class PlasmaWindowManagement;
         class FakeInput;
+        class Keyboard;
+        class Seat;
         class RemoteBuffer;
         class Output;
     }
@@ -59,69 +72,172 @@ public:
 
 protected Q_SLOTS:
     void setupRegistry();
+    void setupWindowManagement();
 
 private:
+    void connectToCompositor();
+    void disconnectFromCompositor();
+    void scheduleReconnect();
+    void teardownWayland();
+
+    // Every protocol object except window management lives on m_thread, so that Wayland
+    // events are not processed in between paint events of whatever dialog is open
+    template<typename Function>
+    void runOnWaylandThread(Function function, Qt::ConnectionType type = Qt::QueuedConnection)
+    {
+        if (m_threadContext) {
+            QMetaObject::invokeMethod(m_threadContext, function, type);
+        }
+    }
+
+    // Sends input on the Wayland thread, function is only called while fake input is bound
+    template<typename Function>
+    void sendInput(Function function, const QString &session = InputLatency::currentSession(), qint64 receivedAt = InputLatency::currentReceipt())
+    {
+        const qint64 queuedAt = InputLatency::timestamp();
+        runOnWaylandThread([this, function, session, receivedAt, queuedAt] {
+            if (m_fakeInput) {
+                function();
+                m_connection->flush();
+                InputLatency::recordFlush(session, receivedAt, queuedAt);
+            }
+        });
+    }
+
     bool m_registryInitialized = false;
 
+    QTimer m_reconnectTimer;
+    int m_reconnectAttempts = 0;
+
     QThread *m_thread = nullptr;
+    QObject *m_threadContext = nullptr;
     KWayland::Client::ConnectionThread *m_connection = nullptr;
     KWayland::Client::EventQueue *m_queue = nullptr;
     KWayland::Client::Registry *m_registry = nullptr;
+
+    // PlasmaWindowManagement feeds Qt models used by our dialogs, hence it gets its own
+    // registry and event queue which are dispatched on the GUI thread
+    KWayland::Client::EventQueue *m_windowManagementQueue = nullptr;
+    KWayland::Client::Registry *m_windowManagementRegistry = nullptr;
     KWayland::Client::PlasmaWindowManagement *m_windowManagement = nullptr;
 
 public:
-    struct Stream {
-        ScreencastingStream *stream = nullptr;
-        uint nodeId;
-        QVariantMap map;
-
-        void close();
-    };
-    typedef QVector<Stream> Streams;
-
     void authenticate();
 
-    bool isStreamingEnabled() const;
     bool isStreamingAvailable() const;
+    bool isVirtualOutputStreamingAvailable() const;
 
-    void startStreamingInput();
-
-    bool startStreaming(ScreencastingStream *stream, QSharedPointer<KWayland::Client::Output> output);
-    bool startStreamingOutput(quint32 outputName, Screencasting::CursorMode mode);
-    bool startStreamingWindow(const QByteArray &winid);
-    void stopStreaming(uint32_t nodeid);
-    void stopAllStreaming();
+    Streams startStreaming(const QList<quint32> &outputNames, const QList<QByteArray> &windows, Screencasting::CursorMode mode);
+    Streams startStreamingVirtualOutput(const QString &name, const QSize &size, qreal scale, Screencasting::CursorMode mode);
 
     void requestPointerButtonPress(quint32 linuxButton);
     void requestPointerButtonRelease(quint32 linuxButton);
-    void requestPointerMotion(const QSizeF &delta);
-    void requestPointerMotionAbsolute(const QPointF &pos);
+    void requestPointerMotion(const QString &session, const QSizeF &delta);
+    void requestPointerMotionAbsolute(const QString &session, quint32 nodeId, const QPointF &pos);
+    void requestPointerAxis(const QString &session, const QSizeF &delta, bool finish);
     void requestPointerAxisDiscrete(Qt::Orientation axis, qreal delta);
     void requestKeyboardKeycode(int keycode, bool state);
-    void bindOutput(int outputName, int outputVersion);
+    void requestKeyboardKeysym(int keysym, bool state);
 
-    QMap<quint32, WaylandOutput> screens();
-    QVariant streams();
+    void requestTouchDown(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos);
+    void requestTouchMotion(const QString &session, quint32 nodeId, quint32 slot, const QPointF &pos);
+    void requestTouchUp(const QString &session, quint32 slot);
+    void releaseInput(const QString &session);
 
-protected Q_SLOTS:
+    InputStatistics inputStatistics() const;
+
+    KWayland::Client::PlasmaWindow *windowForUuid(const QByteArray &uuid) const;
+
+    WaylandOutputs screens() const;
+
+private:
+    struct PendingStream {
+        ScreencastingStream *stream = nullptr;
+        std::optional<quint32> outputName;
+        QPointer<KWayland::Client::PlasmaWindow> window;
+        // Fixed stream properties, for sources that are neither an output nor a window
+        QVariantMap properties;
+        // Name and scale the virtual output was requested with
+        QString virtualOutputName;
+        qreal virtualOutputScale = 1.0;
+    };
+
+    struct StreamSource {
+        std::optional<quint32> outputName;
+        QPointer<KWayland::Client::PlasmaWindow> window;
+        QMetaObject::Connection geometryConnection;
+        // Virtual outputs are matched to their wl_output by name once it is announced
+        QString virtualOutputName;
+        // Last properties sent for the stream, to only announce real changes
+        QVariantMap properties;
+
+        // Maps stream coordinates into the global compositor space, kept up to date as the
+        // output or window moves. Unset while we don't know where the source is.
+        std::optional<QPointF> globalPosition;
+        qreal scale = 1.0;
+    };
+
+    Streams waitForStreams(const std::function<QVector<PendingStream>()> &createStreams);
+    QPointF mapFromStream(quint32 nodeId, const QPointF &pos) const;
+    struct PendingInput;
+    void queueMotion(PendingInput &pending);
+    void flushMotion();
+    int motionFlushInterval() const;
+
+    void trackStream(const Stream &stream, const PendingStream &pendingStream);
+    void untrackStream(uint nodeId);
+    void updateOutputStreams(quint32 outputName);
+    void bindVirtualOutput(StreamSource &source, const WaylandOutput &output);
+
+    // Wayland thread only
     void addOutput(quint32 name, quint32 version);
     void removeOutput(quint32 name);
+    void setOutput(const WaylandOutput &output);
 
-private:
-    bool m_streamInput = false;
-    bool m_waylandAuthenticationRequested = false;
+    std::atomic<bool> m_waylandAuthenticationRequested;
 
     quint32 m_output;
     QDateTime m_lastFrameTime;
-    QVector<Stream> m_streams;
 
+    // Position of the output streamed last, for absolute input on streams we do not know
     QPoint m_streamedScreenPosition;
 
-    QMap<quint32, WaylandOutput> m_outputMap;
-    QList<KWayland::Client::Output*> m_bindOutputs;
+    // Pointer and touch motion is coalesced and sent once per frame unless m_inputPassthrough
+    // is set, any other input event flushes it first to keep the order intact
+    bool m_inputPassthrough = false;
+    QTimer m_motionFlushTimer;
+
+    // Input state of one remote desktop session, so sessions don't mix each other's batches
+    struct PendingInput {
+        std::optional<QPointF> pointerPosition;
+        QSizeF pointerMotion;
+        // Keyed by touch id
+        QHash<quint32, QPointF> touchMotion;
+        // Maps the session's touch slots to the ids we use towards the compositor
+        QHash<quint32, quint32> touchIds;
+        // Scroll amounts too small to be represented on the wire yet
+        QSizeF scroll;
+        QString latencySession;
+        qint64 receipt = 0;
+    };
+    QHash<QString, PendingInput> m_pendingInput;
+    // All sessions share one fake input device, its touch ids must be unique across them
+    QSet<quint32> m_usedTouchIds;
+    InputStatistics m_inputStatistics;
+    QHash<uint, StreamSource> m_streamSources;
+
+    QHash<quint32, QSharedPointer<KWayland::Client::Output>> m_waylandOutputs;
+    WaylandOutputs m_outputs;
+    mutable QMutex m_outputsMutex;
 
     KWayland::Client::FakeInput *m_fakeInput = nullptr;
+    KWayland::Client::Seat *m_seat = nullptr;
+    KWayland::Client::Keyboard *m_keyboard = nullptr;
+    // Wayland thread only, rebuilt whenever the compositor sends a new keymap
+    Keymap m_keymap;
     Screencasting *m_screencasting = nullptr;
+    std::atomic<bool> m_streamingAvailable;
+    std::atomic<bool> m_virtualOutputsAvailable;
 };
 
 }
@@ -23,6 +23,8 @@
 #include <QLoggingCategory>
 
 #include "desktopportal.h"
+#include "inputlatency.h"
+#include "inputrecorder.h"
 
 Q_LOGGING_CATEGORY(XdgDesktopPortalKde, "xdp-kde")
 
@@ -39,6 +41,8 @@ int main(int argc, char *argv[])
         DesktopPortal *desktopPortal = new DesktopPortal(&a);
         if (sessionBus.registerObject(QStringLiteral("/org/freedesktop/portal/desktop"), desktopPortal, QDBusConnection::ExportAdaptors)) {
             qCDebug(XdgDesktopPortalKde) << "Desktop portal registered successfully";
+            InputLatency::init();
+            InputRecorder::init();
         } else {
             qCDebug(XdgDesktopPortalKde) << "Failed to register desktop portal";
         }